@@ -0,0 +1,223 @@
+#include "eztimer/eztimer.hpp"
+
+#include "CLI/App.hpp"
+#include "CLI/Formatter.hpp"
+#include "CLI/Config.hpp"
+
+#include "scaled_ranks.h"
+#include "simulate.h"
+#include "l2_kernels.h"
+#include "early_abandon.h"
+
+#include <random>
+#include <vector>
+#include <optional>
+#include <iostream>
+
+int main(int argc, char ** argv) {
+    CLI::App app{"Early-abandoning L2 performance tests"};
+    int len;
+    app.add_option("-l,--length", len, "Length of the simulated vector")->default_val(1000);
+    double density;
+    app.add_option("-d,--density", density, "Density of non-zero elements in the simulated vector")->default_val(0.2);
+    int nrefs;
+    app.add_option("-n,--references", nrefs, "Number of reference profiles")->default_val(1000);
+    std::vector<double> fractions { 0, 0.5, 0.9, 0.99 };
+    app.add_option("-f,--fraction", fractions, "Fractions of references to be abandoned");
+    int iterations;
+    app.add_option("-i,--iter", iterations, "Number of iterations")->default_val(100);
+    unsigned long long seed;
+    app.add_option("-s,--seed", seed, "Seed for the simulated data")->default_val(69);
+    CLI11_PARSE(app, argc, argv);
+
+    std::mt19937_64 rng(seed);
+
+    // Setting up the references.
+    RankedVector negative, positive;
+    std::vector<std::pair<int, double> > buffer;
+    buffer.reserve(len);
+    std::vector<double> zero_refs(nrefs);
+    std::vector<std::vector<int> > sparse_ref_index(nrefs);
+    std::vector<std::vector<double> > sparse_ref_value(nrefs);
+    std::vector<std::vector<double> > dense_refs(nrefs);
+
+    for (int r = 0; r < nrefs; ++r) {
+        simulate_sparse(len, density, rng, negative, positive);
+        scaled_ranks(len, negative, positive, buffer, zero_refs[r]);
+        std::sort(buffer.begin(), buffer.end());
+        auto& dense_ref = dense_refs[r];
+        dense_ref.resize(len, zero_refs[r]);
+        for (const auto& b : buffer) {
+            sparse_ref_index[r].push_back(b.first);
+            sparse_ref_value[r].push_back(b.second);
+            dense_ref[b.first] = b.second;
+        }
+    }
+
+    // Setting up the query.
+    std::vector<std::pair<int, double> > sparse_query;
+    sparse_query.reserve(len);
+    double zero_query;
+    std::vector<double> dense_query(len);
+    std::vector<double> exact(nrefs);
+    std::vector<double> densified_buffer(len);
+    double bound;
+    std::optional<double> result;
+
+    for (auto fraction : fractions) {
+        eztimer::Options opt;
+        opt.iterations = iterations;
+        opt.setup = [&]() -> void {
+            simulate_sparse(len, density, rng, negative, positive);
+            scaled_ranks(len, negative, positive, sparse_query, zero_query);
+            std::sort(sparse_query.begin(), sparse_query.end());
+            std::fill(dense_query.begin(), dense_query.end(), zero_query);
+            for (const auto& sq : sparse_query) {
+                dense_query[sq.first] = sq.second;
+            }
+
+            // Choosing a bound so that the requested fraction of references have greater L2 norms.
+            // We use the midpoint between adjacent L2 norms so that tiny numerical differences between kernels don't change the results.
+            for (int r = 0; r < nrefs; ++r) {
+                exact[r] = dense_dense(len, dense_query.data(), dense_refs[r].data());
+            }
+            std::sort(exact.begin(), exact.end());
+            const int keep = std::min(nrefs, static_cast<int>(std::round(nrefs * (1 - fraction))));
+            if (keep == 0) {
+                bound = exact.front() / 2;
+            } else if (keep == nrefs) {
+                bound = exact.back() * 2;
+            } else {
+                bound = (exact[keep - 1] + exact[keep]) / 2;
+            }
+
+            result.reset();
+        };
+
+        // Setting up the functions. Each of these returns the number of references with L2 norms below the bound.
+        std::vector<std::function<double()> > funs;
+        std::vector<std::string> names;
+
+        names.push_back("dense-dense");
+        funs.emplace_back([&]() -> double {
+            int found = 0;
+            for (int r = 0; r < nrefs; ++r) {
+                found += dense_dense(len, dense_query.data(), dense_refs[r].data()) <= bound;
+            }
+            return found;
+        });
+
+        names.push_back("dense-dense-bounded");
+        funs.emplace_back([&]() -> double {
+            int found = 0;
+            for (int r = 0; r < nrefs; ++r) {
+                found += dense_dense_bounded(len, dense_query.data(), dense_refs[r].data(), bound) != L2_ABANDONED;
+            }
+            return found;
+        });
+
+        names.push_back("dense-sparse-densified");
+        funs.emplace_back([&]() -> double {
+            int found = 0;
+            for (int r = 0; r < nrefs; ++r) {
+                const double l2 = dense_sparse_densified(
+                    len,
+                    dense_query.data(),
+                    sparse_ref_index[r].size(),
+                    sparse_ref_index[r].data(),
+                    sparse_ref_value[r].data(),
+                    zero_refs[r],
+                    densified_buffer.data()
+                );
+                found += l2 <= bound;
+            }
+            return found;
+        });
+
+        names.push_back("dense-sparse-densified-bounded");
+        funs.emplace_back([&]() -> double {
+            int found = 0;
+            for (int r = 0; r < nrefs; ++r) {
+                const double l2 = dense_sparse_densified_bounded(
+                    len,
+                    dense_query.data(),
+                    sparse_ref_index[r].size(),
+                    sparse_ref_index[r].data(),
+                    sparse_ref_value[r].data(),
+                    zero_refs[r],
+                    densified_buffer.data(),
+                    bound
+                );
+                found += l2 != L2_ABANDONED;
+            }
+            return found;
+        });
+
+        names.push_back("sparse-sparse-interleaved");
+        funs.emplace_back([&]() -> double {
+            int found = 0;
+            for (int r = 0; r < nrefs; ++r) {
+                const double l2 = sparse_sparse_interleaved(
+                    len,
+                    sparse_query.size(),
+                    sparse_query.data(),
+                    zero_query,
+                    sparse_ref_index[r].size(),
+                    sparse_ref_index[r].data(),
+                    sparse_ref_value[r].data(),
+                    zero_refs[r]
+                );
+                found += l2 <= bound;
+            }
+            return found;
+        });
+
+        names.push_back("sparse-sparse-interleaved-bounded");
+        funs.emplace_back([&]() -> double {
+            int found = 0;
+            for (int r = 0; r < nrefs; ++r) {
+                const double l2 = sparse_sparse_interleaved_bounded(
+                    len,
+                    sparse_query.size(),
+                    sparse_query.data(),
+                    zero_query,
+                    sparse_ref_index[r].size(),
+                    sparse_ref_index[r].data(),
+                    sparse_ref_value[r].data(),
+                    zero_refs[r],
+                    bound
+                );
+                found += l2 != L2_ABANDONED;
+            }
+            return found;
+        });
+
+        // Performing the iterations.
+        auto res = eztimer::time<double>(
+            funs,
+            [&](const double& res, std::size_t i) -> void {
+                if (result.has_value()) {
+                    if (*result != res) {
+                        std::cout << *result << "\t" << res << "\t" << names[i] << std::endl;
+                        throw std::runtime_error("oops that's not right");
+                    }
+                } else {
+                    result = res;
+                }
+            },
+            opt
+        );
+
+        std::cout << "Abandoning " << fraction * 100 << "% of references" << std::endl;
+        for (std::size_t n = 0; n < names.size(); ++n) {
+            std::string nn = names[n];
+            nn.resize(36, ' ');
+            const double mu = res[n].mean.count(); 
+            const double se = res[n].sd.count() / std::sqrt(res[n].times.size());
+            std::cout << nn << ": " << mu << " ± " << (se / mu * 100) << " %" << std::endl;
+        }
+        std::cout << std::endl;
+    }
+
+    return 0;
+}
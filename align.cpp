@@ -0,0 +1,132 @@
+#include "eztimer/eztimer.hpp"
+
+#include "CLI/App.hpp"
+#include "CLI/Formatter.hpp"
+#include "CLI/Config.hpp"
+
+#include "scaled_ranks.h"
+#include "simulate.h"
+#include "l2_kernels.h"
+#include "aligned_buffer.h"
+
+#include <random>
+#include <vector>
+#include <optional>
+#include <iostream>
+#include <algorithm>
+
+int main(int argc, char ** argv) {
+    CLI::App app{"Aligned and padded buffer performance tests"};
+    std::vector<int> lengths { 99, 1001, 10003 };
+    app.add_option("-l,--length", lengths, "Lengths of the simulated vectors");
+    double density;
+    app.add_option("-d,--density", density, "Density of non-zero elements in the simulated vector")->default_val(0.2);
+    int nrefs;
+    app.add_option("-n,--references", nrefs, "Number of references")->default_val(1000);
+    int iterations;
+    app.add_option("-i,--iter", iterations, "Number of iterations")->default_val(100);
+    unsigned long long seed;
+    app.add_option("-s,--seed", seed, "Seed for the simulated data")->default_val(69);
+    CLI11_PARSE(app, argc, argv);
+
+    std::mt19937_64 rng(seed);
+    RankedVector negative, positive;
+    std::vector<std::pair<int, double> > buffer;
+
+    for (const int len : lengths) {
+        std::cout << "# Length: " << len << std::endl;
+
+        // Storing the dense references in a matrix where each row is one reference.
+        // With the usual std::vector, the rows are packed so that most of them are not aligned unless the length is a multiple of 8;
+        // with the AlignedVector, each row is padded to a multiple of 64 bytes, with zeros in the padding.
+        const std::size_t stride = len, padded_stride = padded_length<double>(len);
+        std::vector<double> dense_refs(stride * nrefs);
+        AlignedVector<double> dense_refs_padded(padded_stride * nrefs);
+        for (int r = 0; r < nrefs; ++r) {
+            simulate_sparse(len, density, rng, negative, positive);
+            double zero;
+            scaled_ranks(len, negative, positive, buffer, zero);
+            double* dense = dense_refs.data() + stride * r;
+            std::fill_n(dense, len, zero);
+            for (const auto& b : buffer) {
+                dense[b.first] = b.second;
+            }
+            std::copy_n(dense, len, dense_refs_padded.data() + padded_stride * r);
+        }
+
+        std::vector<double> dense_query(len);
+        AlignedVector<double> dense_query_padded(len);
+        std::optional<double> result;
+
+        eztimer::Options opt;
+        opt.iterations = iterations;
+        opt.setup = [&]() -> void {
+            simulate_sparse(len, density, rng, negative, positive);
+            double zero;
+            scaled_ranks(len, negative, positive, buffer, zero);
+            std::fill(dense_query.begin(), dense_query.end(), zero);
+            for (const auto& b : buffer) {
+                dense_query[b.first] = b.second;
+            }
+            std::copy(dense_query.begin(), dense_query.end(), dense_query_padded.begin());
+            result.reset();
+        };
+
+        // Each function returns the sum of the L2 distances to all references.
+        std::vector<std::function<double()> > funs;
+        std::vector<std::string> names;
+
+        names.push_back("dense-dense");
+        funs.emplace_back([&]() -> double {
+            double total = 0;
+            for (int r = 0; r < nrefs; ++r) {
+                total += dense_dense(len, dense_query.data(), dense_refs.data() + stride * r);
+            }
+            return total;
+        });
+
+        names.push_back("simd-unaligned-tail");
+        funs.emplace_back([&]() -> double {
+            double total = 0;
+            for (int r = 0; r < nrefs; ++r) {
+                total += simd_dense_dense<false>(len, dense_query.data(), dense_refs.data() + stride * r);
+            }
+            return total;
+        });
+
+        names.push_back("simd-aligned-padded");
+        funs.emplace_back([&]() -> double {
+            double total = 0;
+            for (int r = 0; r < nrefs; ++r) {
+                total += simd_dense_dense<true>(len, dense_query_padded.data(), dense_refs_padded.data() + padded_stride * r);
+            }
+            return total;
+        });
+
+        auto res = eztimer::time<double>(
+            funs,
+            [&](const double& res, std::size_t i) -> void {
+                if (result.has_value()) {
+                    if (std::abs(*result - res) > 1e-8 * std::abs(res)) {
+                        std::cout << *result << "\t" << res << "\t" << names[i] << std::endl;
+                        throw std::runtime_error("oops that's not right");
+                    }
+                } else {
+                    result = res;
+                }
+            },
+            opt
+        );
+
+        for (std::size_t n = 0; n < names.size(); ++n) {
+            std::string nn = names[n];
+            nn.resize(32, ' ');
+            const double mu = res[n].mean.count();
+            const double se = res[n].sd.count() / std::sqrt(res[n].times.size());
+            std::cout << nn << ": " << mu << " ± " << (se / mu * 100) << " %" << std::endl;
+        }
+        std::cout << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,127 @@
+#ifndef ALIGNED_BUFFER_H
+#define ALIGNED_BUFFER_H
+
+#include <vector>
+#include <new>
+#include <cstddef>
+#include <cstring>
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// Allocator for dense buffers that are aligned to and padded up to a multiple of 64 bytes, i.e., the widest SIMD register.
+// The padding beyond the requested size is zero-filled, so a SIMD kernel can always process whole registers without a scalar tail,
+// as long as the padding of each operand contributes zero to the result (e.g., the L2 distance between zero paddings is zero).
+// Note that the padding is outside of the vector's size(), so it is left untouched by std::fill() and friends.
+// The padding is only zeroed after the capacity, so this should be used for buffers that are sized on construction and never resized;
+// check has_zero_padding() before passing a buffer to a kernel that relies on the padding.
+constexpr std::size_t simd_alignment = 64;
+
+// Number of elements of type 'T' after padding 'n' to a multiple of simd_alignment bytes.
+template<typename T>
+std::size_t padded_length(const std::size_t n) {
+    constexpr std::size_t per_register = simd_alignment / sizeof(T);
+    return (n + per_register - 1) / per_register * per_register;
+}
+
+template<typename T>
+struct AlignedAllocator {
+    typedef T value_type;
+
+    AlignedAllocator() = default;
+
+    template<typename U>
+    AlignedAllocator(const AlignedAllocator<U>&) {}
+
+    T* allocate(const std::size_t n) {
+        const std::size_t padded = padded_length<T>(n);
+        T* ptr = static_cast<T*>(::operator new(padded * sizeof(T), std::align_val_t(simd_alignment)));
+        std::memset(static_cast<void*>(ptr + n), 0, (padded - n) * sizeof(T));
+        return ptr;
+    }
+
+    void deallocate(T* ptr, const std::size_t) {
+        ::operator delete(ptr, std::align_val_t(simd_alignment));
+    }
+
+    template<typename U>
+    bool operator==(const AlignedAllocator<U>&) const {
+        return true;
+    }
+
+    template<typename U>
+    bool operator!=(const AlignedAllocator<U>&) const {
+        return false;
+    }
+};
+
+template<typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T> >;
+
+// Whether the padding after the end of 'x' is guaranteed to be zero.
+// This is not the case if the capacity exceeds the size, e.g., after a shrinking resize() or a reserve(),
+// as the space between the size and capacity may contain stale values and is not covered by the allocator's zero-filled padding.
+template<typename T>
+bool has_zero_padding(const AlignedVector<T>& x) {
+    return x.capacity() == x.size();
+}
+
+// Dense-dense L2 distance with explicit SIMD, for comparing aligned/padded and plain buffers.
+// If 'Padded_ = true', both pointers should come from AlignedVectors so that we can use aligned loads over the padded length;
+// otherwise, we use unaligned loads and finish with a scalar tail.
+template<bool Padded_>
+double simd_dense_dense(const std::size_t num_markers, const double* left, const double* right) {
+    std::size_t i = 0;
+    double l2 = 0;
+
+#if defined(__AVX512F__)
+    __m512d acc = _mm512_setzero_pd();
+    if constexpr (Padded_) {
+        for (const std::size_t end = padded_length<double>(num_markers); i < end; i += 8) {
+            const __m512d delta = _mm512_sub_pd(_mm512_load_pd(left + i), _mm512_load_pd(right + i));
+            acc = _mm512_fmadd_pd(delta, delta, acc);
+        }
+    } else {
+        for (; i + 8 <= num_markers; i += 8) {
+            const __m512d delta = _mm512_sub_pd(_mm512_loadu_pd(left + i), _mm512_loadu_pd(right + i));
+            acc = _mm512_fmadd_pd(delta, delta, acc);
+        }
+    }
+    alignas(64) double lanes[8];
+    _mm512_store_pd(lanes, acc);
+    l2 = ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) + ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]));
+#elif defined(__AVX2__) && defined(__FMA__)
+    __m256d acc = _mm256_setzero_pd();
+    if constexpr (Padded_) {
+        for (const std::size_t end = padded_length<double>(num_markers); i < end; i += 4) {
+            const __m256d delta = _mm256_sub_pd(_mm256_load_pd(left + i), _mm256_load_pd(right + i));
+            acc = _mm256_fmadd_pd(delta, delta, acc);
+        }
+    } else {
+        for (; i + 4 <= num_markers; i += 4) {
+            const __m256d delta = _mm256_sub_pd(_mm256_loadu_pd(left + i), _mm256_loadu_pd(right + i));
+            acc = _mm256_fmadd_pd(delta, delta, acc);
+        }
+    }
+    alignas(32) double lanes[4];
+    _mm256_store_pd(lanes, acc);
+    l2 = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#endif
+
+    if constexpr (!Padded_) {
+        for (; i < num_markers; ++i) {
+            const double delta = left[i] - right[i];
+            l2 += delta * delta;
+        }
+    } else {
+        // Without any SIMD, this just runs over the zero padding as well.
+        for (const std::size_t end = padded_length<double>(num_markers); i < end; ++i) {
+            const double delta = left[i] - right[i];
+            l2 += delta * delta;
+        }
+    }
+    return l2;
+}
+
+#endif
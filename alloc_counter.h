@@ -0,0 +1,144 @@
+#ifndef ALLOC_COUNTER_H
+#define ALLOC_COUNTER_H
+
+#include <atomic>
+#include <vector>
+#include <functional>
+#include <cstdlib>
+#include <cstddef>
+#include <new>
+
+// Counting replacements for the global operator new and delete, to check that the hot kernels do not allocate in the steady state.
+// The replacements cannot be inline, so this header should only be included in one translation unit of each binary.
+inline std::atomic<std::size_t> alloc_counter_calls(0);
+inline std::atomic<std::size_t> alloc_counter_bytes(0);
+
+inline void* alloc_counter_allocate(std::size_t size) {
+    alloc_counter_calls.fetch_add(1, std::memory_order_relaxed);
+    alloc_counter_bytes.fetch_add(size, std::memory_order_relaxed);
+    if (size == 0) {
+        size = 1;
+    }
+    return std::malloc(size);
+}
+
+inline void* alloc_counter_allocate(std::size_t size, const std::size_t alignment) {
+    alloc_counter_calls.fetch_add(1, std::memory_order_relaxed);
+    alloc_counter_bytes.fetch_add(size, std::memory_order_relaxed);
+    // aligned_alloc() requires the size to be a multiple of the alignment.
+    size = (size + alignment - 1) / alignment * alignment;
+    if (size == 0) {
+        size = alignment;
+    }
+    return std::aligned_alloc(alignment, size);
+}
+
+void* operator new(std::size_t size) {
+    void* ptr = alloc_counter_allocate(size);
+    if (!ptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    return alloc_counter_allocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return alloc_counter_allocate(size);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    void* ptr = alloc_counter_allocate(size, static_cast<std::size_t>(alignment));
+    if (!ptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+    return operator new(size, alignment);
+}
+
+// GCC warns about free() on memory from operator new once the replacements are inlined, but here that is exactly what we want.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+struct AllocationCounts {
+    double calls = 0;
+    double bytes = 0;
+};
+
+// Mean number of allocations and bytes allocated per call to each kernel.
+// We run 'rounds' rounds of setup followed by one call to each kernel, counting every call including the first after each setup.
+// Kernels should reserve() their buffers up front, so even the first call on new data should not allocate;
+// this should be run before any other calls to the kernels, otherwise buffers that were grown by earlier calls will hide a missing reserve().
+template<typename Output_>
+std::vector<AllocationCounts> count_allocations(const std::vector<std::function<Output_()> >& funs, const std::function<void()>& setup, const int rounds) {
+    std::vector<AllocationCounts> output(funs.size());
+    for (int r = 0; r < rounds; ++r) {
+        if (setup) {
+            setup();
+        }
+        for (std::size_t f = 0; f < funs.size(); ++f) {
+            const std::size_t before_calls = alloc_counter_calls.load(std::memory_order_relaxed);
+            const std::size_t before_bytes = alloc_counter_bytes.load(std::memory_order_relaxed);
+            funs[f]();
+            output[f].calls += alloc_counter_calls.load(std::memory_order_relaxed) - before_calls;
+            output[f].bytes += alloc_counter_bytes.load(std::memory_order_relaxed) - before_bytes;
+        }
+    }
+
+    if (rounds > 0) {
+        for (auto& o : output) {
+            o.calls /= rounds;
+            o.bytes /= rounds;
+        }
+    }
+    return output;
+}
+
+#endif
@@ -5,12 +5,33 @@
 #include "CLI/Config.hpp"
 
 #include "scaled_ranks.h"
+#include "harness.h"
+#include "alloc_counter.h"
+#include "aligned_buffer.h"
+#include "exact_ranks.h"
 
 #include <random>
 #include <vector>
 #include <optional>
 #include <iostream>
 #include <limits>
+#include <numeric>
+#include <stdexcept>
+
+struct Reference {
+    std::vector<std::pair<int, double> > sparse_ref;
+    std::vector<int> sparse_ref_index;
+    std::vector<double> sparse_ref_value;
+    double zero_ref = 0;
+    AlignedVector<double> dense_ref;
+
+    std::vector<std::int32_t> sparse_ref_doubled;
+    std::vector<std::int16_t> sparse_ref_doubled16;
+    std::int32_t zero_ref_doubled = 0;
+    std::int64_t ss_ref_doubled = 0;
+    std::vector<std::int32_t> dense_ref_doubled;
+    std::vector<std::int16_t> dense_ref_doubled16;
+};
 
 int main(int argc, char ** argv) {
     CLI::App app{"Sparse L2 calculation performance tests"};
@@ -22,6 +43,16 @@ int main(int argc, char ** argv) {
     app.add_option("-i,--iter", iterations, "Number of iterations")->default_val(100);
     unsigned long long seed;
     app.add_option("-s,--seed", seed, "Seed for the simulated data")->default_val(69);
+    bool precise;
+    app.add_flag("-p,--precise", precise, "Batch repeated calls into each timed sample and subtract the call overhead");
+    double target;
+    app.add_option("-t,--target", target, "Target duration of each timed sample in seconds, when --precise is set")->default_val(1e-4);
+    double working_set;
+    app.add_option("-w,--working-set", working_set, "Size of the reference working set in bytes, for cache-cold timings (0 = single hot reference)")->default_val(0);
+    bool allocations;
+    app.add_flag("-a,--allocations", allocations, "Report the number of allocations per kernel call");
+    bool forbid_allocations;
+    app.add_flag("--forbid-allocations", forbid_allocations, "Fail if any kernel allocates in the steady state (implies --allocations)");
     CLI11_PARSE(app, argc, argv);
 
     // Setting up all of the data structures.
@@ -31,7 +62,7 @@ int main(int argc, char ** argv) {
     std::vector<std::pair<int, double> > sparse_query_unsorted;
     sparse_query_unsorted.reserve(len);
     double zero_query;
-    std::vector<double> dense_query(len);
+    AlignedVector<double> dense_query(len);
 
     RankedVector negative_ref, positive_ref;
     std::vector<std::pair<int, double> > sparse_ref;
@@ -41,7 +72,26 @@ int main(int argc, char ** argv) {
     std::vector<double> sparse_ref_value;
     sparse_ref_value.reserve(len);
     double zero_ref;
-    std::vector<double> dense_ref(len);
+    AlignedVector<double> dense_ref(len);
+
+    // Doubled ranks for the exact integer kernels, using int16 if the number of markers is small enough.
+    const bool use_int16 = doubled_ranks_fit<std::int16_t>(len);
+    std::vector<std::pair<int, std::int32_t> > doubled_tmp;
+    doubled_tmp.reserve(len);
+
+    std::vector<std::int32_t> dense_query_doubled(len);
+    std::vector<std::int16_t> dense_query_doubled16(use_int16 ? len : 0);
+    std::int32_t zero_query_doubled;
+    std::int64_t ss_query_doubled;
+
+    std::vector<std::int32_t> sparse_ref_doubled;
+    sparse_ref_doubled.reserve(len);
+    std::vector<std::int16_t> sparse_ref_doubled16;
+    sparse_ref_doubled16.reserve(use_int16 ? len : 0);
+    std::int32_t zero_ref_doubled;
+    std::int64_t ss_ref_doubled;
+    std::vector<std::int32_t> dense_ref_doubled(len);
+    std::vector<std::int16_t> dense_ref_doubled16(use_int16 ? len : 0);
 
     std::optional<double> result;
 
@@ -50,6 +100,94 @@ int main(int argc, char ** argv) {
     std::normal_distribution<> normdist;
     std::uniform_real_distribution<> unifdist;
 
+    auto simulate_reference = [&]() -> void {
+        negative_ref.clear();
+        positive_ref.clear();
+        for (int i = 0; i < len; ++i) {
+            if (unifdist(rng) <= density) {
+                double val = normdist(rng);
+                if (val < 0) {
+                    negative_ref.emplace_back(val, i);
+                } else if (val > 0) {
+                    positive_ref.emplace_back(val, i);
+                }
+            }
+        }
+
+        std::sort(negative_ref.begin(), negative_ref.end());
+        std::sort(positive_ref.begin(), positive_ref.end());
+        scaled_ranks(len, negative_ref, positive_ref, sparse_ref, zero_ref);
+        std::sort(sparse_ref.begin(), sparse_ref.end());
+
+        sparse_ref_index.clear();
+        sparse_ref_value.clear();
+        dense_ref.resize(len);
+        if (!has_zero_padding(dense_ref)) {
+            throw std::runtime_error("dense reference should have zero padding for simd_dense_dense()");
+        }
+        std::fill(dense_ref.begin(), dense_ref.end(), zero_ref);
+        for (const auto& sr : sparse_ref) {
+            sparse_ref_index.push_back(sr.first);
+            sparse_ref_value.push_back(sr.second);
+            dense_ref[sr.first] = sr.second;
+        }
+
+        ss_ref_doubled = doubled_ranks(len, negative_ref, positive_ref, doubled_tmp, zero_ref_doubled);
+        std::sort(doubled_tmp.begin(), doubled_tmp.end());
+        sparse_ref_doubled.clear();
+        dense_ref_doubled.resize(len);
+        std::fill(dense_ref_doubled.begin(), dense_ref_doubled.end(), zero_ref_doubled);
+        for (const auto& dt : doubled_tmp) {
+            sparse_ref_doubled.push_back(dt.second);
+            dense_ref_doubled[dt.first] = dt.second;
+        }
+        if (use_int16) {
+            sparse_ref_doubled16.resize(sparse_ref_doubled.size());
+            std::copy(sparse_ref_doubled.begin(), sparse_ref_doubled.end(), sparse_ref_doubled16.begin());
+            dense_ref_doubled16.resize(len);
+            std::copy(dense_ref_doubled.begin(), dense_ref_doubled.end(), dense_ref_doubled16.begin());
+        }
+    };
+
+    auto swap_reference = [&](Reference& other) -> void {
+        sparse_ref.swap(other.sparse_ref);
+        sparse_ref_index.swap(other.sparse_ref_index);
+        sparse_ref_value.swap(other.sparse_ref_value);
+        std::swap(zero_ref, other.zero_ref);
+        dense_ref.swap(other.dense_ref);
+
+        sparse_ref_doubled.swap(other.sparse_ref_doubled);
+        sparse_ref_doubled16.swap(other.sparse_ref_doubled16);
+        std::swap(zero_ref_doubled, other.zero_ref_doubled);
+        std::swap(ss_ref_doubled, other.ss_ref_doubled);
+        dense_ref_doubled.swap(other.dense_ref_doubled);
+        dense_ref_doubled16.swap(other.dense_ref_doubled16);
+    };
+
+    // In working set mode, we build a pool of references that is (hopefully) larger than the last-level cache.
+    // Each kernel call then loops over all references in a random order, so every reference is cold when it is used.
+    // Swapping a pool entry into the variables used by the kernels only involves a few pointers, so it does not warm up the cache.
+    std::vector<Reference> pool;
+    std::vector<int> pool_order;
+    double pool_nonzero = 0;
+    if (working_set > 0) {
+        double pool_bytes = 0;
+        while (pool_bytes < working_set) {
+            simulate_reference();
+            pool.emplace_back();
+            swap_reference(pool.back());
+            const auto& current = pool.back();
+            pool_nonzero += current.sparse_ref.size();
+            pool_bytes += current.dense_ref.size() * sizeof(double) + current.sparse_ref.size() * (sizeof(std::pair<int, double>) + sizeof(int) + sizeof(double));
+            pool_bytes += current.dense_ref_doubled.size() * sizeof(std::int32_t) + current.dense_ref_doubled16.size() * sizeof(std::int16_t) + current.sparse_ref_doubled.size() * sizeof(std::int32_t);
+            pool_bytes += current.sparse_ref_doubled16.size() * sizeof(std::int16_t);
+        }
+        pool_nonzero /= pool.size();
+        pool_order.resize(pool.size());
+        std::iota(pool_order.begin(), pool_order.end(), 0);
+        std::cout << "Using " << pool.size() << " references (" << pool_bytes << " bytes)" << std::endl;
+    }
+
     eztimer::Options opt;
     opt.iterations = iterations;
     opt.setup = [&]() -> void {
@@ -77,33 +215,20 @@ int main(int argc, char ** argv) {
             dense_query[sq.first] = sq.second;
         }
 
-        // Generating the reference elements.
-        negative_ref.clear();
-        positive_ref.clear();
-        for (int i = 0; i < len; ++i) {
-            if (unifdist(rng) <= density) {
-                double val = normdist(rng);
-                if (val < 0) {
-                    negative_ref.emplace_back(val, i);
-                } else if (val > 0) {
-                    positive_ref.emplace_back(val, i);
-                }
-            }
+        ss_query_doubled = doubled_ranks(len, negative_query, positive_query, doubled_tmp, zero_query_doubled);
+        std::fill(dense_query_doubled.begin(), dense_query_doubled.end(), zero_query_doubled);
+        for (const auto& dt : doubled_tmp) {
+            dense_query_doubled[dt.first] = dt.second;
+        }
+        if (use_int16) {
+            std::copy(dense_query_doubled.begin(), dense_query_doubled.end(), dense_query_doubled16.begin());
         }
 
-        std::sort(negative_ref.begin(), negative_ref.end());
-        std::sort(positive_ref.begin(), positive_ref.end());
-        scaled_ranks(len, negative_ref, positive_ref, sparse_ref, zero_ref);
-        std::sort(sparse_ref.begin(), sparse_ref.end());
-
-        sparse_ref_index.clear();
-        sparse_ref_value.clear();
-        dense_ref.resize(len);
-        std::fill(dense_ref.begin(), dense_ref.end(), zero_ref);
-        for (const auto& sr : sparse_ref) {
-            sparse_ref_index.push_back(sr.first);
-            sparse_ref_value.push_back(sr.second);
-            dense_ref[sr.first] = sr.second;
+        // Generating the reference elements.
+        if (pool.empty()) {
+            simulate_reference();
+        } else {
+            std::shuffle(pool_order.begin(), pool_order.end(), rng);
         }
 
         result.reset();
@@ -123,6 +248,12 @@ int main(int argc, char ** argv) {
         return l2;
     });
 
+    // The dense buffers are AlignedVectors, so we can use aligned SIMD loads over the zero-padded length.
+    names.push_back("dense-dense-aligned");
+    funs.emplace_back([&]() -> double {
+        return simd_dense_dense<true>(len, dense_query.data(), dense_ref.data());
+    });
+
     names.push_back("sparse-dense-interleaved");
     funs.emplace_back([&]() -> double {
         int i = 0, j = 0;
@@ -176,7 +307,7 @@ int main(int argc, char ** argv) {
     });
 
     names.push_back("dense-sparse-densified");
-    std::vector<double> buffer_ds(len);
+    AlignedVector<double> buffer_ds(len);
     funs.emplace_back([&]() -> double {
         std::fill(buffer_ds.begin(), buffer_ds.end(), zero_ref);
         for (const auto& ss : sparse_ref) {
@@ -191,8 +322,18 @@ int main(int argc, char ** argv) {
         return val;
     });
 
+    names.push_back("dense-sparse-densified-aligned");
+    funs.emplace_back([&]() -> double {
+        std::fill(buffer_ds.begin(), buffer_ds.end(), zero_ref);
+        for (const auto& ss : sparse_ref) {
+            buffer_ds[ss.first] = ss.second;
+        }
+
+        return simd_dense_dense<true>(len, dense_query.data(), buffer_ds.data());
+    });
+
     names.push_back("dense-sparse-densified2");
-    std::vector<double> sd_mapping(len);
+    AlignedVector<double> sd_mapping(len);
     funs.emplace_back([&]() -> double {
         const int num = sparse_ref_index.size();
         for (int i = 0; i < num; ++i) {
@@ -291,28 +432,129 @@ int main(int argc, char ** argv) {
         return l2;
     });
 
-    // Performing the iterations.
-    auto res = eztimer::time<double>(
-        funs,
-        [&](const double& res, std::size_t i) -> void {
-            if (result.has_value()) {
-                if (std::abs(*result - res) / res > 1e-8) {
-                    std::cout << *result << "\t" << res << "\t" << names[i] << std::endl;
-                    throw std::runtime_error("oops that's not right");
+    names.push_back("dense-dense-exact");
+    funs.emplace_back([&]() -> double {
+        const auto dot = dense_dense_dot(len, dense_query_doubled.data(), dense_ref_doubled.data());
+        return exact_l2(dot, ss_query_doubled, ss_ref_doubled);
+    });
+
+    names.push_back("dense-sparse-exact");
+    funs.emplace_back([&]() -> double {
+        const auto dot = dense_sparse_dot(dense_query_doubled.data(), sparse_ref_index.size(), sparse_ref_index.data(), sparse_ref_doubled.data(), zero_ref_doubled);
+        return exact_l2(dot, ss_query_doubled, ss_ref_doubled);
+    });
+
+    if (use_int16) {
+        names.push_back("dense-dense-exact16");
+        funs.emplace_back([&]() -> double {
+            const auto dot = dense_dense_dot(len, dense_query_doubled16.data(), dense_ref_doubled16.data());
+            return exact_l2(dot, ss_query_doubled, ss_ref_doubled);
+        });
+
+        names.push_back("dense-sparse-exact16");
+        funs.emplace_back([&]() -> double {
+            const auto dot = dense_sparse_dot(dense_query_doubled16.data(), sparse_ref_index.size(), sparse_ref_index.data(), sparse_ref_doubled16.data(), static_cast<std::int16_t>(zero_ref_doubled));
+            return exact_l2(dot, ss_query_doubled, ss_ref_doubled);
+        });
+    }
+
+    // Bytes of reference data used by each kernel per call, for reporting the effective bandwidth in working set mode.
+    // The dense query and the scratch buffers are always hot, so they are not counted here.
+    const double dense_bytes = len * sizeof(double);
+    const double sparse_bytes = pool_nonzero * (sizeof(int) + sizeof(double));
+    const double pair_bytes = pool_nonzero * sizeof(std::pair<int, double>);
+    const double gather_bytes = pool_nonzero * sizeof(double);
+    const double sparse_exact_bytes = pool_nonzero * (sizeof(int) + sizeof(std::int32_t));
+    const double sparse_exact16_bytes = pool_nonzero * (sizeof(int) + sizeof(std::int16_t));
+    std::vector<double> traffic {
+        dense_bytes,                // dense-dense
+        dense_bytes,                // dense-dense-aligned
+        dense_bytes,                // sparse-dense-interleaved
+        sparse_bytes,               // dense-sparse-interleaved
+        pair_bytes,                 // dense-sparse-densified
+        pair_bytes,                 // dense-sparse-densified-aligned
+        sparse_bytes + pair_bytes,  // dense-sparse-densified2
+        sparse_bytes,               // dense-sparse-unstable
+        gather_bytes,               // sparse-dense-unstable-unsorted
+        sparse_bytes,               // sparse-sparse-interleaved
+        dense_bytes / 2,            // dense-dense-exact
+        sparse_exact_bytes          // dense-sparse-exact
+    };
+    if (use_int16) {
+        traffic.push_back(dense_bytes / 4);     // dense-dense-exact16
+        traffic.push_back(sparse_exact16_bytes);  // dense-sparse-exact16
+    }
+    if (traffic.size() != funs.size()) {
+        throw std::runtime_error("traffic estimates should be provided for all kernels");
+    }
+
+    if (!pool.empty()) {
+        for (auto& f : funs) {
+            f = [&,kernel=std::move(f)]() -> double {
+                double total = 0;
+                for (auto r : pool_order) {
+                    swap_reference(pool[r]);
+                    total += kernel();
+                    swap_reference(pool[r]);
                 }
+                return total;
+            };
+        }
+    }
+
+    // Performing the iterations.
+    auto check = [&](const double& res, std::size_t i) -> void {
+        if (result.has_value()) {
+            if (std::abs(*result - res) / res > 1e-8) {
+                std::cout << *result << "\t" << res << "\t" << names[i] << std::endl;
+                throw std::runtime_error("oops that's not right");
+            }
+        } else {
+            result = res;
+        }
+    };
+
+    auto report = [&](const auto& res) -> void {
+        for (std::size_t n = 0; n < names.size(); ++n) {
+            std::string nn = names[n];
+            nn.resize(32, ' ');
+            const double mu = res[n].mean.count(); 
+            const double se = res[n].sd.count() / std::sqrt(res[n].times.size());
+            if (pool.empty()) {
+                std::cout << nn << ": " << mu << " ± " << (se / mu * 100) << " %" << std::endl;
             } else {
-                result = res;
+                const double per_call = mu / pool.size();
+                std::cout << nn << ": " << per_call << " ± " << (se / mu * 100) << " %, " << (traffic[n] / per_call / 1e9) << " GB/s" << std::endl;
             }
-        },
-        opt
-    );
-
-    for (std::size_t n = 0; n < names.size(); ++n) {
-        std::string nn = names[n];
-        nn.resize(32, ' ');
-        const double mu = res[n].mean.count(); 
-        const double se = res[n].sd.count() / std::sqrt(res[n].times.size());
-        std::cout << nn << ": " << mu << " ± " << (se / mu * 100) << " %" << std::endl;
+        }
+    };
+
+    if (allocations || forbid_allocations) {
+        // All kernels here are meant to be allocation-free once their buffers have been reserved.
+        // This is done before the timings so that the buffers have not yet been grown by any earlier calls.
+        auto counts = count_allocations(funs, opt.setup, iterations);
+        std::cout << "Allocations per call:" << std::endl;
+        bool any_allocated = false;
+        for (std::size_t n = 0; n < names.size(); ++n) {
+            std::string nn = names[n];
+            nn.resize(32, ' ');
+            std::cout << nn << ": " << counts[n].calls << " (" << counts[n].bytes << " bytes)" << std::endl;
+            any_allocated = any_allocated || counts[n].calls > 0;
+        }
+        if (forbid_allocations && any_allocated) {
+            throw std::runtime_error("kernels should not allocate in the steady state");
+        }
+        std::cout << std::endl;
+    }
+
+    if (precise) {
+        BatchOptions bopt;
+        bopt.iterations = iterations;
+        bopt.setup = opt.setup;
+        bopt.target = target;
+        report(batch_time<double>(funs, check, bopt));
+    } else {
+        report(eztimer::time<double>(funs, check, opt));
     }
 
     return 0;
@@ -0,0 +1,97 @@
+#ifndef COMPACT_REFERENCE_H
+#define COMPACT_REFERENCE_H
+
+#include <vector>
+#include <utility>
+#include <cmath>
+
+#include "scaled_ranks.h"
+
+// Compact storage of a sparse reference profile in a single RankedVector.
+// All non-zero values are sorted together, so the negative values come first and 'split' marks the start of the positive values.
+// The zeros are implicit and are inserted between the two when computing ranks.
+// This avoids storing two RankedVectors (and their separate heap allocations) for each of the many reference profiles.
+struct CompactReference {
+    RankedVector nonzero;
+    int split = 0;
+
+    void clear() {
+        nonzero.clear();
+        split = 0;
+    }
+};
+
+// Fills 'output' from value-sorted 'negative' and 'positive' vectors.
+inline void compact_reference(const RankedVector& negative, const RankedVector& positive, CompactReference& output) {
+    output.nonzero.clear();
+    output.nonzero.insert(output.nonzero.end(), negative.begin(), negative.end());
+    output.nonzero.insert(output.nonzero.end(), positive.begin(), positive.end());
+    output.split = negative.size();
+}
+
+// Equivalent to the sparse scaled_ranks(), but walking through all non-zero values in a single loop.
+// Runs of tied values never cross the split as the negative and positive values cannot be equal,
+// so we only need to insert the zero block when the loop reaches the split.
+template<class ZeroProcess_, class Process_>
+bool scaled_ranks(
+    const int num_markers,
+    const CompactReference& reference,
+    std::vector<std::pair<int, double> >& buffer,
+    ZeroProcess_ zero,
+    Process_ process
+) {
+    buffer.clear();
+    if (num_markers == 0) {
+        zero(0);
+        return false;
+    }
+
+    const double center_rank = static_cast<double>(num_markers - 1) / static_cast<double>(2);
+    double sum_squares = 0;
+
+    const auto& nonzero = reference.nonzero;
+    const int num_nonzero = nonzero.size();
+    const int num_zero = num_markers - num_nonzero;
+    double zero_rank = 0;
+
+    // 'offset' is the number of zeros before the current position, i.e., either 0 or 'num_zero'.
+    int cur = 0, offset = 0;
+    while (true) {
+        if (cur == reference.split && num_zero) {
+            zero_rank = cur + static_cast<double>(num_zero - 1) / static_cast<double>(2) - center_rank;
+            sum_squares += zero_rank * zero_rank * num_zero;
+            offset = num_zero;
+        }
+        if (cur == num_nonzero) {
+            break;
+        }
+
+        int copy = cur;
+        do {
+            ++copy;
+        } while (copy < num_nonzero && nonzero[copy].first == nonzero[cur].first);
+
+        const double jump = copy - cur;
+        const double mean_rank = cur + offset + (jump - 1) / static_cast<double>(2) - center_rank;
+        sum_squares += mean_rank * mean_rank * jump;
+        for (; cur < copy; ++cur) {
+            buffer.emplace_back(nonzero[cur].second, mean_rank);
+        }
+    }
+
+    // Special behaviour for no-variance cells; these are left as all-zero scaled ranks.
+    if (sum_squares == 0) {
+        zero(0);
+        buffer.clear();
+        return false;
+    }
+
+    const double denom = 0.5 / std::sqrt(sum_squares);
+    zero(zero_rank * denom);
+    for (auto& nz : buffer) {
+        process(nz, nz.second * denom);
+    }
+    return true;
+}
+
+#endif
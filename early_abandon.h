@@ -0,0 +1,119 @@
+#ifndef EARLY_ABANDON_H
+#define EARLY_ABANDON_H
+
+#include <algorithm>
+#include <utility>
+#include <limits>
+
+// Threshold-aware versions of the stable kernels in l2_kernels.h.
+// The stable kernels only ever add non-negative terms, so the running sum is a lower bound on the final L2;
+// once it exceeds the caller-supplied bound, we can stop and return L2_ABANDONED instead.
+// (Any L2 greater than the bound is reported as L2_ABANDONED, even if it was only detected at the end.)
+// The running sum is only checked at the end of every EARLY_ABANDON_BLOCK elements to avoid a branch in the inner loop.
+// This is not possible for dense-sparse-unstable as its running sum is not monotonic.
+constexpr double L2_ABANDONED = std::numeric_limits<double>::infinity();
+constexpr int EARLY_ABANDON_BLOCK = 64;
+
+inline double dense_dense_bounded(const int num_markers, const double* dense_query, const double* dense_ref, const double bound) {
+    double l2 = 0;
+    int i = 0;
+    while (i < num_markers) {
+        const int end = std::min(num_markers, i + EARLY_ABANDON_BLOCK);
+        for (; i < end; ++i) {
+            const double delta = dense_query[i] - dense_ref[i];
+            l2 += delta * delta;
+        }
+        if (l2 > bound) {
+            return L2_ABANDONED;
+        }
+    }
+    return l2;
+}
+
+inline double dense_sparse_densified_bounded(
+    const int num_markers,
+    const double* dense_query,
+    const int num_nonzero,
+    const int* sparse_ref_index,
+    const double* sparse_ref_value,
+    const double zero_ref,
+    double* buffer,
+    const double bound
+) {
+    std::fill_n(buffer, num_markers, zero_ref);
+    for (int i = 0; i < num_nonzero; ++i) {
+        buffer[sparse_ref_index[i]] = sparse_ref_value[i];
+    }
+    return dense_dense_bounded(num_markers, dense_query, buffer, bound);
+}
+
+inline double sparse_sparse_interleaved_bounded(
+    const int num_markers,
+    const int num_query,
+    const std::pair<int, double>* sparse_query,
+    const double zero_query,
+    const int num_ref,
+    const int* sparse_ref_index,
+    const double* sparse_ref_value,
+    const double zero_ref,
+    const double bound
+) {
+    double l2 = 0;
+    int i1 = 0, i2 = 0;
+    int both = 0;
+    int until_check = EARLY_ABANDON_BLOCK;
+
+    if (i1 < num_query && i2 < num_ref) {
+        while (1) {
+            const auto idx1 = sparse_query[i1].first;
+            const auto idx2 = sparse_ref_index[i2];
+            if (idx1 < idx2) {
+                const double delta = sparse_query[i1].second - zero_ref;
+                l2 += delta * delta;
+                ++i1;
+                if (i1 == num_query) {
+                    break;
+                }
+            } else if (idx1 > idx2) {
+                const double delta = sparse_ref_value[i2] - zero_query;
+                l2 += delta * delta;
+                ++i2;
+                if (i2 == num_ref) {
+                    break;
+                }
+            } else {
+                const double delta = sparse_query[i1].second - sparse_ref_value[i2];
+                l2 += delta * delta;
+                ++i1;
+                ++i2;
+                ++both;
+                if (i1 == num_query || i2 == num_ref) {
+                    break;
+                }
+            }
+
+            --until_check;
+            if (until_check == 0) {
+                if (l2 > bound) {
+                    return L2_ABANDONED;
+                }
+                until_check = EARLY_ABANDON_BLOCK;
+            }
+        }
+    }
+
+    for (; i1 < num_query; ++i1) {
+        const double delta = sparse_query[i1].second - zero_ref;
+        l2 += delta * delta;
+    }
+    for (; i2 < num_ref; ++i2) {
+        const double delta = sparse_ref_value[i2] - zero_query;
+        l2 += delta * delta;
+    }
+
+    const double delta = zero_query - zero_ref;
+    l2 += (num_markers - num_query - (num_ref - both)) * (delta * delta);
+    return (l2 > bound ? L2_ABANDONED : l2);
+}
+
+#endif
@@ -0,0 +1,167 @@
+#ifndef EXACT_RANKS_H
+#define EXACT_RANKS_H
+
+#include <algorithm>
+#include <vector>
+#include <utility>
+#include <limits>
+#include <cmath>
+#include <cstdint>
+
+#if defined(__AVX512BW__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "scaled_ranks.h"
+
+// Exact L2 calculations with integer arithmetic.
+// Tied centered ranks are always multiples of 0.5, so doubling them gives us integers in [-(num_markers - 1), num_markers - 1].
+// The scaled ranks are just the doubled ranks divided by 2 * sqrt(SS), where SS is the sum of squares of the doubled ranks,
+// so the L2 norm between two scaled rank vectors A and B is 0.5 - 0.5 * dot(A, B) / sqrt(SS_A * SS_B).
+// The dot product and sums of squares are computed exactly with integers, and we only convert to floating point at the very end.
+// This avoids the cancellation in the unstable kernels, where 0.25 and len * zero^2 are both much larger than the final L2.
+//
+// Doubled ranks can be stored as int16 if num_markers < 32768, or int32 otherwise.
+template<typename Value_>
+bool doubled_ranks_fit(const int num_markers) {
+    return static_cast<std::int64_t>(num_markers) - 1 <= static_cast<std::int64_t>(std::numeric_limits<Value_>::max());
+}
+
+// Sparse doubled ranks for the non-zero values, in the same order as scaled_ranks().
+// The doubled rank of the zero values is stored in 'zero', and the sum of squares across all markers is returned.
+template<typename Value_>
+std::int64_t doubled_ranks(
+    const int num_markers,
+    const RankedVector& negative,
+    const RankedVector& positive,
+    std::vector<std::pair<int, Value_> >& buffer,
+    Value_& zero
+) {
+    buffer.clear();
+    zero = 0;
+    std::int64_t sum_squares = 0;
+    std::int64_t cur_rank = 0;
+
+    // Doubled version of 'cur_rank + (jump - 1) / 2 - (num_markers - 1) / 2'.
+    auto add_ties = [&](const RankedVector& ranked) -> void {
+        auto it = ranked.begin();
+        const auto end = ranked.end();
+        while (it != end) {
+            auto copy = it;
+            do {
+                ++copy;
+            } while (copy != end && copy->first == it->first);
+
+            const std::int64_t jump = copy - it;
+            const std::int64_t doubled = 2 * cur_rank + jump - num_markers;
+            sum_squares += doubled * doubled * jump;
+
+            while (it != copy) {
+                buffer.emplace_back(it->second, doubled);
+                ++it;
+            }
+
+            cur_rank += jump;
+        }
+    };
+
+    add_ties(negative);
+
+    const std::int64_t num_zero = num_markers - negative.size() - positive.size();
+    if (num_zero) {
+        const std::int64_t doubled = 2 * cur_rank + num_zero - num_markers;
+        sum_squares += doubled * doubled * num_zero;
+        zero = doubled;
+        cur_rank += num_zero;
+    }
+
+    add_ties(positive);
+    return sum_squares;
+}
+
+// Converting the exact integer quantities into the L2 norm between scaled ranks.
+// No-variance profiles have all-zero scaled ranks, matching the behavior of scaled_ranks().
+inline double exact_l2(const std::int64_t dot, const std::int64_t sum_squares_query, const std::int64_t sum_squares_ref) {
+    if (sum_squares_query == 0 || sum_squares_ref == 0) {
+        return (sum_squares_query == 0 && sum_squares_ref == 0 ? 0 : 0.25);
+    }
+    const double denom = std::sqrt(static_cast<double>(sum_squares_query)) * std::sqrt(static_cast<double>(sum_squares_ref));
+    return 0.5 - 0.5 * static_cast<double>(dot) / denom;
+}
+
+template<typename Value_>
+std::int64_t dense_dense_dot(const int num_markers, const Value_* dense_query, const Value_* dense_ref) {
+    std::int64_t dot = 0;
+    for (int i = 0; i < num_markers; ++i) {
+        dot += static_cast<std::int64_t>(dense_query[i]) * static_cast<std::int64_t>(dense_ref[i]);
+    }
+    return dot;
+}
+
+// For int16, pmaddwd (or vpdpwssd with VNNI) multiplies pairs of elements and sums adjacent products into int32 lanes.
+// Each product is at most (num_markers - 1)^2, so a lane can safely absorb INT32_MAX / (2 * (num_markers - 1)^2) steps
+// before we need to widen the accumulator into the 64-bit total.
+inline std::int64_t dense_dense_dot(const int num_markers, const std::int16_t* dense_query, const std::int16_t* dense_ref) {
+    std::int64_t dot = 0;
+    int i = 0;
+
+#if defined(__AVX512BW__) || defined(__AVX2__)
+    const std::int64_t max_rank = std::max(num_markers - 1, 1);
+    const std::int64_t steps_per_flush = std::numeric_limits<std::int32_t>::max() / (2 * max_rank * max_rank);
+#endif
+
+#if defined(__AVX512BW__)
+    constexpr int width = 32;
+    while (i + width <= num_markers) {
+        __m512i acc = _mm512_setzero_si512();
+        for (std::int64_t s = 0; s < steps_per_flush && i + width <= num_markers; ++s, i += width) {
+            const __m512i q = _mm512_loadu_si512(dense_query + i);
+            const __m512i r = _mm512_loadu_si512(dense_ref + i);
+#if defined(__AVX512VNNI__)
+            acc = _mm512_dpwssd_epi32(acc, q, r);
+#else
+            acc = _mm512_add_epi32(acc, _mm512_madd_epi16(q, r));
+#endif
+        }
+        alignas(64) std::int32_t lanes[16];
+        _mm512_store_si512(lanes, acc);
+        for (auto l : lanes) {
+            dot += l;
+        }
+    }
+#elif defined(__AVX2__)
+    constexpr int width = 16;
+    while (i + width <= num_markers) {
+        __m256i acc = _mm256_setzero_si256();
+        for (std::int64_t s = 0; s < steps_per_flush && i + width <= num_markers; ++s, i += width) {
+            const __m256i q = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dense_query + i));
+            const __m256i r = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dense_ref + i));
+            acc = _mm256_add_epi32(acc, _mm256_madd_epi16(q, r));
+        }
+        alignas(32) std::int32_t lanes[8];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), acc);
+        for (auto l : lanes) {
+            dot += l;
+        }
+    }
+#endif
+
+    for (; i < num_markers; ++i) {
+        dot += static_cast<std::int32_t>(dense_query[i]) * static_cast<std::int32_t>(dense_ref[i]);
+    }
+    return dot;
+}
+
+// For a sparse reference with doubled zero rank Z, the dense query's ranks sum to zero, so the contribution of the zero entries
+// is Z * (0 - sum of the query at the non-zero entries). This gives us dot = sum over non-zero entries of A_j * (B_j - Z).
+template<typename Query_, typename Ref_>
+std::int64_t dense_sparse_dot(const Query_* dense_query, const int num_nonzero, const int* sparse_ref_index, const Ref_* sparse_ref_value, const Ref_ zero_ref) {
+    std::int64_t dot = 0;
+    for (int i = 0; i < num_nonzero; ++i) {
+        const std::int64_t ref = static_cast<std::int64_t>(sparse_ref_value[i]) - static_cast<std::int64_t>(zero_ref);
+        dot += static_cast<std::int64_t>(dense_query[sparse_ref_index[i]]) * ref;
+    }
+    return dot;
+}
+
+#endif
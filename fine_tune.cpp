@@ -5,6 +5,13 @@
 #include "CLI/Config.hpp"
 
 #include "scaled_ranks.h"
+#include "harness.h"
+#include "alloc_counter.h"
+#include "aligned_buffer.h"
+#include "fixed_size.h"
+#include "tie_scan.h"
+#include "compact_reference.h"
+#include "scratch_buffer.h"
 
 #include <random>
 #include <vector>
@@ -14,376 +21,626 @@
 
 int main(int argc, char ** argv) {
     CLI::App app{"Sparse L2 calculation performance tests"};
-    int len;
-    app.add_option("-l,--length", len, "Length of the simulated vector")->default_val(1000);
+    std::vector<int> lengths { 1000 };
+    app.add_option("-l,--length", lengths, "Length of the simulated vector, or multiple lengths to run the tests for each");
     double density;
     app.add_option("-d,--density", density, "Density of non-zero elements in the simulated vector")->default_val(0.2);
     int iterations;
     app.add_option("-i,--iter", iterations, "Number of iterations")->default_val(100);
     unsigned long long seed;
     app.add_option("-s,--seed", seed, "Seed for the simulated data")->default_val(69);
+    bool counts;
+    app.add_flag("-c,--counts", counts, "Simulate non-zero elements as integer counts with many ties, instead of continuous values");
+    bool precise;
+    app.add_flag("-p,--precise", precise, "Batch repeated calls into each timed sample and subtract the call overhead");
+    double target;
+    app.add_option("-t,--target", target, "Target duration of each timed sample in seconds, when --precise is set")->default_val(1e-4);
+    bool allocations;
+    app.add_flag("-a,--allocations", allocations, "Report the number of allocations per kernel call");
+    bool forbid_allocations;
+    app.add_flag("--forbid-allocations", forbid_allocations, "Fail if any kernel allocates in the steady state (implies --allocations)");
     CLI11_PARSE(app, argc, argv);
 
-    // Setting up all of the data structures.
-    RankedVector negative_query, positive_query;
-    std::vector<std::pair<int, double> > sparse_query, sparse_query_unsorted;
-    sparse_query.reserve(len);
-    sparse_query_unsorted.reserve(len);
-    double zero_query;
-    std::vector<double> dense_query(len);
-
-    RankedVector negative_ref, positive_ref, full_ref;
-    std::optional<double> result;
-
-    // Setting up the simulation at each iteration.
-    std::mt19937_64 rng(seed);
-    std::normal_distribution<> normdist;
-    std::uniform_real_distribution<> unifdist;
-
-    eztimer::Options opt;
-    opt.iterations = iterations;
-    opt.setup = [&]() -> void {
-        // Generating the query elements.
-        // We assume that all of these are already sorted by index as it's not much effort to do it once for the query.
-        negative_query.clear();
-        positive_query.clear();
-        for (int i = 0; i < len; ++i) {
-            if (unifdist(rng) <= density) {
-                double val = normdist(rng);
-                if (val < 0) {
-                    negative_query.emplace_back(val, i);
-                } else if (val > 0) {
-                    positive_query.emplace_back(val, i);
+    for (const int len : lengths) {
+        if (lengths.size() > 1) {
+            std::cout << "# Length: " << len << std::endl;
+        }
+
+        // Setting up all of the data structures.
+        RankedVector negative_query, positive_query;
+        std::vector<std::pair<int, double> > sparse_query, sparse_query_unsorted;
+        sparse_query.reserve(len);
+        sparse_query_unsorted.reserve(len);
+        double zero_query;
+        AlignedVector<double> dense_query(len);
+        AlignedVector<double> dense_query_padded(std::max(len, max_fixed_size));
+
+        RankedVector negative_ref, positive_ref, full_ref;
+        RankedArrays negative_ref_soa, positive_ref_soa, full_ref_soa;
+        negative_ref_soa.reserve(len);
+        positive_ref_soa.reserve(len);
+        full_ref_soa.reserve(len);
+        CompactReference compact_ref;
+        compact_ref.nonzero.reserve(len);
+        AlignedVector<double> raw_ref(len);
+        std::optional<double> result;
+
+        // Setting up the simulation at each iteration.
+        std::mt19937_64 rng(seed);
+        std::normal_distribution<> normdist;
+        std::uniform_real_distribution<> unifdist;
+        std::poisson_distribution<> poisdist(2);
+
+        eztimer::Options opt;
+        opt.iterations = iterations;
+        opt.setup = [&]() -> void {
+            // Generating the query elements.
+            // We assume that all of these are already sorted by index as it's not much effort to do it once for the query.
+            negative_query.clear();
+            positive_query.clear();
+            for (int i = 0; i < len; ++i) {
+                if (unifdist(rng) <= density) {
+                    double val = (counts ? poisdist(rng) : normdist(rng));
+                    if (val < 0) {
+                        negative_query.emplace_back(val, i);
+                    } else if (val > 0) {
+                        positive_query.emplace_back(val, i);
+                    }
                 }
             }
-        }
 
-        std::sort(negative_query.begin(), negative_query.end());
-        std::sort(positive_query.begin(), positive_query.end());
-        scaled_ranks(len, negative_query, positive_query, sparse_query, zero_query);
-        sparse_query_unsorted = sparse_query;
-        std::sort(sparse_query.begin(), sparse_query.end());
-        std::fill(dense_query.begin(), dense_query.end(), zero_query);
-        for (const auto& sq : sparse_query) {
-            dense_query[sq.first] = sq.second;
-        }
+            std::sort(negative_query.begin(), negative_query.end());
+            std::sort(positive_query.begin(), positive_query.end());
+            scaled_ranks(len, negative_query, positive_query, sparse_query, zero_query);
+            sparse_query_unsorted = sparse_query;
+            std::sort(sparse_query.begin(), sparse_query.end());
+            std::fill(dense_query.begin(), dense_query.end(), zero_query);
+            for (const auto& sq : sparse_query) {
+                dense_query[sq.first] = sq.second;
+            }
+            std::copy(dense_query.begin(), dense_query.end(), dense_query_padded.begin());
+
+            // Generating the reference elements.
+            // These are sorted by value, not index, because that avoids a round of resorting after subsetting. 
+            negative_ref.clear();
+            positive_ref.clear();
+            full_ref.clear();
+            for (int i = 0; i < len; ++i) {
+                if (unifdist(rng) <= density) {
+                    double val = (counts ? poisdist(rng) : normdist(rng));
+                    if (val < 0) {
+                        negative_ref.emplace_back(val, i);
+                    } else if (val > 0) {
+                        positive_ref.emplace_back(val, i);
+                    }
+                    full_ref.emplace_back(val, i);
+                    raw_ref[i] = val;
+                } else {
+                    full_ref.emplace_back(0, i);
+                    raw_ref[i] = 0;
+                }
+            }
 
-        // Generating the reference elements.
-        // These are sorted by value, not index, because that avoids a round of resorting after subsetting. 
-        negative_ref.clear();
-        positive_ref.clear();
-        full_ref.clear();
-        for (int i = 0; i < len; ++i) {
-            if (unifdist(rng) <= density) {
-                double val = normdist(rng);
-                if (val < 0) {
-                    negative_ref.emplace_back(val, i);
-                } else if (val > 0) {
-                    positive_ref.emplace_back(val, i);
+            std::sort(negative_ref.begin(), negative_ref.end());
+            std::sort(positive_ref.begin(), positive_ref.end());
+            std::sort(full_ref.begin(), full_ref.end());
+
+            // Making structure-of-arrays copies of the sorted references.
+            auto to_soa = [](const RankedVector& aos, RankedArrays& soa) -> void {
+                soa.clear();
+                for (const auto& x : aos) {
+                    soa.emplace_back(x.first, x.second);
                 }
-                full_ref.emplace_back(val, i);
-            } else {
-                full_ref.emplace_back(0, i);
+            };
+            to_soa(negative_ref, negative_ref_soa);
+            to_soa(positive_ref, positive_ref_soa);
+            to_soa(full_ref, full_ref_soa);
+            compact_reference(negative_ref, positive_ref, compact_ref);
+
+            result.reset();
+        };
+
+        // Setting up the functions.
+        std::vector<std::function<double()> > funs;
+        std::vector<std::string> names;
+
+        names.push_back("dense-dense");
+        AlignedVector<double> dd_buffer(len);
+        funs.emplace_back([&]() -> double {
+            double l2 = 0;
+            scaled_ranks(
+                len,
+                full_ref,
+                dd_buffer.data(),
+                [&](const int i, const double val) -> void {
+                    const double delta = dense_query[i] - val;
+                    l2 += delta * delta;
+                }
+            );
+            return l2;
+        });
+
+        // In practice, the reference values need to be re-sorted after subsetting to the markers for each round of fine-tuning.
+        // These two kernels include that sort, so they should be compared to each other rather than to the others.
+        names.push_back("dense-dense-resort");
+        RankedVector ddr_sorted;
+        ddr_sorted.reserve(len);
+        funs.emplace_back([&]() -> double {
+            ddr_sorted.clear();
+            for (int i = 0; i < len; ++i) {
+                ddr_sorted.emplace_back(raw_ref[i], i);
             }
+            std::sort(ddr_sorted.begin(), ddr_sorted.end());
+
+            double l2 = 0;
+            scaled_ranks(
+                len,
+                ddr_sorted,
+                dd_buffer.data(),
+                [&](const int i, const double val) -> void {
+                    const double delta = dense_query[i] - val;
+                    l2 += delta * delta;
+                }
+            );
+            return l2;
+        });
+
+        AlignedVector<double> ddf_buffer(max_fixed_size);
+        if (len <= max_fixed_size) {
+            names.push_back("dense-dense-fixed");
+            funs.emplace_back([&]() -> double {
+                double l2 = 0;
+                dispatch_fixed_size(len, [&](auto size) -> void {
+                    fixed_scaled_ranks<size.value>(len, raw_ref.data(), ddf_buffer.data());
+                    l2 = fixed_l2<size.value>(dense_query_padded.data(), ddf_buffer.data());
+                });
+                return l2;
+            });
         }
 
-        std::sort(negative_ref.begin(), negative_ref.end());
-        std::sort(positive_ref.begin(), positive_ref.end());
-        std::sort(full_ref.begin(), full_ref.end());
-
-        result.reset();
-    };
-
-    // Setting up the functions.
-    std::vector<std::function<double()> > funs;
-    std::vector<std::string> names;
-
-    names.push_back("dense-dense");
-    std::vector<double> dd_buffer(len);
-    funs.emplace_back([&]() -> double {
-        double l2 = 0;
-        scaled_ranks(
-            len,
-            full_ref,
-            dd_buffer.data(),
-            [&](const int i, const double val) -> void {
-                const double delta = dense_query[i] - val;
+        names.push_back("sparse-dense-interleaved");
+        AlignedVector<double> sd_buffer(len);
+        funs.emplace_back([&]() -> double {
+            scaled_ranks(
+                len,
+                full_ref,
+                sd_buffer.data(),
+                [&](const int i, const double val) -> void {
+                    sd_buffer[i] = val;
+                }
+            );
+
+            int i = 0, j = 0;
+            const int snum = sparse_query.size();
+            double l2 = 0;
+
+            while (j < snum) {
+                const auto limit = sparse_query[j].first;
+                for (; i < limit; ++i) {
+                    const auto delta = sd_buffer[i] - zero_query;
+                    l2 += delta * delta;
+                }
+                const auto delta = sd_buffer[i] - sparse_query[j].second;
                 l2 += delta * delta;
+                ++i;
+                ++j;
             }
-        );
-        return l2;
-    });
-
-    names.push_back("sparse-dense-interleaved");
-    std::vector<double> sd_buffer(len);
-    funs.emplace_back([&]() -> double {
-        scaled_ranks(
-            len,
-            full_ref,
-            sd_buffer.data(),
-            [&](const int i, const double val) -> void {
-                sd_buffer[i] = val;
-            }
-        );
 
-        int i = 0, j = 0;
-        const int snum = sparse_query.size();
-        double l2 = 0;
-
-        while (j < snum) {
-            const auto limit = sparse_query[j].first;
-            for (; i < limit; ++i) {
+            for (; i < len; ++i) {
                 const auto delta = sd_buffer[i] - zero_query;
                 l2 += delta * delta;
             }
-            const auto delta = sd_buffer[i] - sparse_query[j].second;
-            l2 += delta * delta;
-            ++i;
-            ++j;
-        }
 
-        for (; i < len; ++i) {
-            const auto delta = sd_buffer[i] - zero_query;
-            l2 += delta * delta;
-        }
+            return l2;
+        });
+
+        names.push_back("dense-sparse-interleaved");
+        std::vector<std::pair<int, double> > dsi_tmp;
+        dsi_tmp.reserve(len);
+        funs.emplace_back([&]() -> double {
+            double zero_ref;
+            scaled_ranks(
+                len,
+                negative_ref,
+                positive_ref,
+                dsi_tmp,
+                [&](const double zval) -> void {
+                    zero_ref = zval;
+                },
+                [&](std::pair<int, double>& pair, const double val) -> void {
+                    pair.second = val;
+                }
+            );
+            std::sort(dsi_tmp.begin(), dsi_tmp.end());
 
-        return l2;
-    });
-
-    names.push_back("dense-sparse-interleaved");
-    std::vector<std::pair<int, double> > dsi_tmp;
-    dsi_tmp.reserve(len);
-    funs.emplace_back([&]() -> double {
-        double zero_ref;
-        scaled_ranks(
-            len,
-            negative_ref,
-            positive_ref,
-            dsi_tmp,
-            [&](const double zval) -> void {
-                zero_ref = zval;
-            },
-            [&](std::pair<int, double>& pair, const double val) -> void {
-                pair.second = val;
-            }
-        );
-        std::sort(dsi_tmp.begin(), dsi_tmp.end());
+            int i = 0, j = 0;
+            const int snum = dsi_tmp.size();
+            double l2 = 0;
 
-        int i = 0, j = 0;
-        const int snum = dsi_tmp.size();
-        double l2 = 0;
+            while (j < snum) {
+                const auto limit = dsi_tmp[j].first;
+                for (; i < limit; ++i) {
+                    const auto delta = dense_query[i] - zero_ref;
+                    l2 += delta * delta;
+                }
+                const auto delta = dense_query[i] - dsi_tmp[j].second;
+                l2 += delta * delta;
+                ++i;
+                ++j;
+            }
 
-        while (j < snum) {
-            const auto limit = dsi_tmp[j].first;
-            for (; i < limit; ++i) {
+            for (; i < len; ++i) {
                 const auto delta = dense_query[i] - zero_ref;
                 l2 += delta * delta;
             }
-            const auto delta = dense_query[i] - dsi_tmp[j].second;
-            l2 += delta * delta;
-            ++i;
-            ++j;
-        }
 
-        for (; i < len; ++i) {
-            const auto delta = dense_query[i] - zero_ref;
-            l2 += delta * delta;
-        }
+            return l2;
+        });
+
+        names.push_back("dense-sparse-densified");
+        std::vector<std::pair<int, double> > dsd_tmp;
+        dsd_tmp.reserve(len);
+        AlignedVector<double> dsd_buffer(len);
+        funs.emplace_back([&]() -> double {
+            scaled_ranks(
+                len,
+                negative_ref,
+                positive_ref,
+                dsd_tmp,
+                [&](const double zval) -> void {
+                    std::fill(dsd_buffer.begin(), dsd_buffer.end(), zval);
+                },
+                [&](std::pair<int, double>& pair, const double val) -> void {
+                    dsd_buffer[pair.first] = val;
+                }
+            );
 
-        return l2;
-    });
-
-    names.push_back("dense-sparse-densified");
-    std::vector<std::pair<int, double> > dsd_tmp;
-    dsd_tmp.reserve(len);
-    std::vector<double> dsd_buffer(len);
-    funs.emplace_back([&]() -> double {
-        scaled_ranks(
-            len,
-            negative_ref,
-            positive_ref,
-            dsd_tmp,
-            [&](const double zval) -> void {
-                std::fill(dsd_buffer.begin(), dsd_buffer.end(), zval);
-            },
-            [&](std::pair<int, double>& pair, const double val) -> void {
-                dsd_buffer[pair.first] = val;
+            double val = 0;
+            for (int i = 0; i < len; ++i) {
+                const double delta = dense_query[i] - dsd_buffer[i];
+                val += delta * delta;
             }
-        );
+            return val;
+        });
+
+        // The buffers are AlignedVectors, so we can use aligned SIMD loads over the zero-padded length.
+        names.push_back("dense-sparse-densified-aligned");
+        funs.emplace_back([&]() -> double {
+            scaled_ranks(
+                len,
+                negative_ref,
+                positive_ref,
+                dsd_tmp,
+                [&](const double zval) -> void {
+                    std::fill(dsd_buffer.begin(), dsd_buffer.end(), zval);
+                },
+                [&](std::pair<int, double>& pair, const double val) -> void {
+                    dsd_buffer[pair.first] = val;
+                }
+            );
+
+            return simd_dense_dense<true>(len, dense_query.data(), dsd_buffer.data());
+        });
+
+        names.push_back("dense-sparse-densified2");
+        std::vector<std::pair<int, double> > dsd2_tmp;
+        dsd2_tmp.reserve(len);
+        AlignedVector<double> dsd2_mapping(len);
+        funs.emplace_back([&]() -> double {
+            double zero_ref;
+            scaled_ranks(
+                len,
+                negative_ref,
+                positive_ref,
+                dsd2_tmp,
+                [&](const double zval) -> void {
+                    zero_ref = zval;
+                },
+                [&](std::pair<int, double>& pair, const double val) -> void {
+                    dsd2_mapping[pair.first] = val - zero_ref;
+                }
+            );
 
-        double val = 0;
-        for (int i = 0; i < len; ++i) {
-            const double delta = dense_query[i] - dsd_buffer[i];
-            val += delta * delta;
-        }
-        return val;
-    });
-
-    names.push_back("dense-sparse-densified2");
-    std::vector<std::pair<int, double> > dsd2_tmp;
-    dsd2_tmp.reserve(len);
-    std::vector<double> dsd2_mapping(len);
-    funs.emplace_back([&]() -> double {
-        double zero_ref;
-        scaled_ranks(
-            len,
-            negative_ref,
-            positive_ref,
-            dsd2_tmp,
-            [&](const double zval) -> void {
-                zero_ref = zval;
-            },
-            [&](std::pair<int, double>& pair, const double val) -> void {
-                dsd2_mapping[pair.first] = val - zero_ref;
+            double val = 0;
+            for (int i = 0; i < len; ++i) {
+                const double delta = (dense_query[i] - (dsd2_mapping[i] + zero_ref));
+                val += delta * delta;
             }
-        );
-
-        double val = 0;
-        for (int i = 0; i < len; ++i) {
-            const double delta = (dense_query[i] - (dsd2_mapping[i] + zero_ref));
-            val += delta * delta;
-        }
 
-        for (const auto& ss : dsd2_tmp) {
-            dsd2_mapping[ss.first] = 0;
-        }
-        return val;
-    });
-
-    names.push_back("dense-sparse-unstable");
-    std::vector<std::pair<int, double> > asu_tmp;
-    asu_tmp.reserve(len);
-    funs.emplace_back([&]() -> double {
-        double l2 = 0, zero_ref;
-        bool has_nonzero = scaled_ranks(
-            len,
-            negative_ref,
-            positive_ref,
-            asu_tmp,
-            [&](const double zval) -> void {
-                zero_ref = zval;
-            },
-            [&](std::pair<int, double>& pair, const double val) -> void {
-                const double target = dense_query[pair.first];
-                const double ref = val - zero_ref;
-                l2 += ref * (ref - 2 * target);
+            for (const auto& ss : dsd2_tmp) {
+                dsd2_mapping[ss.first] = 0;
             }
-        );
-        return (has_nonzero ? 0.25 : 0) + l2 - len * zero_ref * zero_ref;
-    });
-
-    names.push_back("sparse-dense-unstable");
-    std::vector<double> sdu_buffer(len);
-    funs.emplace_back([&]() -> double {
-        // Similar to dense-sparse-unstable except that the query is the sparse one.
-        // This means we need to compute the centered ranks for the dense reference.
-        auto ss = centered_ranks(len, full_ref, sdu_buffer.data());
-        const double mult = (ss ? 0.5 / std::sqrt(ss) : 0);
-        const int num = sparse_query.size();
-        double l2 = 0;
-        for (int i = 0; i < num; ++i) {
-            const auto& current = sparse_query[i];
-            const double target = sdu_buffer[current.first] * mult;
-            const double query = current.second - zero_query;
-            l2 += query * (query - 2 * target);
-        }
-        const double x2 = (num == 0 ? 0 : 0.25);
-        return x2 + l2 - len * zero_query * zero_query;
-    });
-
-    names.push_back("sparse-dense-unstable-unsorted");
-    std::vector<double> sduu_buffer(len);
-    funs.emplace_back([&]() -> double {
-        // Similar to dense-sparse-unstable except that the query is the sparse one.
-        // This means we need to compute the centered ranks for the dense reference.
-        auto ss = centered_ranks(len, full_ref, sduu_buffer.data());
-        const double mult = (ss ? 0.5 / std::sqrt(ss) : 0);
-        const int num = sparse_query_unsorted.size();
-        double l2 = 0;
-        for (int i = 0; i < num; ++i) {
-            const auto& current = sparse_query_unsorted[i];
-            const double target = sduu_buffer[current.first] * mult;
-            const double query = current.second - zero_query;
-            l2 += query * (query - 2 * target);
-        }
-        const double x2 = (num == 0 ? 0 : 0.25);
-        return x2 + l2 - len * zero_query * zero_query;
-    });
-
-    names.push_back("sparse-sparse-interleaved");
-    std::vector<std::pair<int, double> > ssi_tmp;
-    ssi_tmp.reserve(len);
-    funs.emplace_back([&]() -> double {
-        double zero_ref;
-        scaled_ranks(
-            len,
-            negative_ref,
-            positive_ref,
-            ssi_tmp,
-            [&](const double zval) -> void {
-                zero_ref = zval;
-            },
-            [&](std::pair<int, double>& pair, const double val) -> void {
-                pair.second = val;
+            return val;
+        });
+
+        // Same as dense-sparse-densified, but the buffer never needs to be filled or reset.
+        names.push_back("dense-sparse-generation");
+        std::vector<std::pair<int, double> > dsg_tmp;
+        dsg_tmp.reserve(len);
+        GenerationBuffer dsg_buffer(len);
+        funs.emplace_back([&]() -> double {
+            double zero_ref;
+            dsg_buffer.next();
+            scaled_ranks(
+                len,
+                negative_ref,
+                positive_ref,
+                dsg_tmp,
+                [&](const double zval) -> void {
+                    zero_ref = zval;
+                },
+                [&](std::pair<int, double>& pair, const double val) -> void {
+                    dsg_buffer.set(pair.first, val);
+                }
+            );
+
+            const auto* entries = dsg_buffer.entries();
+            const std::uint32_t generation = dsg_buffer.generation();
+            double val = 0;
+            for (int i = 0; i < len; ++i) {
+                // Loading the value unconditionally so that the compiler emits a select instead of a branch.
+                const double candidate = entries[i].value;
+                const double ref = (entries[i].stamp == generation ? candidate : zero_ref);
+                const double delta = dense_query[i] - ref;
+                val += delta * delta;
             }
-        );
-        std::sort(ssi_tmp.begin(), ssi_tmp.end());
-
-        double l2 = 0;
-        int i1 = 0, i2 = 0;
-        int both = 0;
-        const int snum1 = sparse_query.size();
-        const int snum2 = ssi_tmp.size();
-
-        if (i1 < snum1 && i2 < snum2) { 
-            while (1) {
-                const auto idx1 = sparse_query[i1].first;
-                const auto idx2 = ssi_tmp[i2].first;
-                if (idx1 < idx2) {
-                    const double delta = sparse_query[i1].second - zero_ref;
-                    l2 += delta * delta;
-                    ++i1;
-                    if (i1 == snum1) {
-                        break;
-                    }
-                } else if (idx1 > idx2) {
-                    const double delta = ssi_tmp[i2].second - zero_query;
-                    l2 += delta * delta;
-                    ++i2;
-                    if (i2 == snum2) {
-                        break;
-                    }
-                } else {
-                    const double delta = sparse_query[i1].second - ssi_tmp[i2].second;
-                    l2 += delta * delta;
-                    ++i1;
-                    ++i2;
-                    ++both;
-                    if (i1 == snum1 || i2 == snum2) {
-                        break;
+            return val;
+        });
+
+        names.push_back("dense-sparse-unstable");
+        std::vector<std::pair<int, double> > asu_tmp;
+        asu_tmp.reserve(len);
+        funs.emplace_back([&]() -> double {
+            double l2 = 0, zero_ref;
+            bool has_nonzero = scaled_ranks(
+                len,
+                negative_ref,
+                positive_ref,
+                asu_tmp,
+                [&](const double zval) -> void {
+                    zero_ref = zval;
+                },
+                [&](std::pair<int, double>& pair, const double val) -> void {
+                    const double target = dense_query[pair.first];
+                    const double ref = val - zero_ref;
+                    l2 += ref * (ref - 2 * target);
+                }
+            );
+            return (has_nonzero ? 0.25 : 0) + l2 - len * zero_ref * zero_ref;
+        });
+
+        names.push_back("sparse-dense-unstable");
+        AlignedVector<double> sdu_buffer(len);
+        funs.emplace_back([&]() -> double {
+            // Similar to dense-sparse-unstable except that the query is the sparse one.
+            // This means we need to compute the centered ranks for the dense reference.
+            auto ss = centered_ranks(len, full_ref, sdu_buffer.data());
+            const double mult = (ss ? 0.5 / std::sqrt(ss) : 0);
+            const int num = sparse_query.size();
+            double l2 = 0;
+            for (int i = 0; i < num; ++i) {
+                const auto& current = sparse_query[i];
+                const double target = sdu_buffer[current.first] * mult;
+                const double query = current.second - zero_query;
+                l2 += query * (query - 2 * target);
+            }
+            const double x2 = (num == 0 ? 0 : 0.25);
+            return x2 + l2 - len * zero_query * zero_query;
+        });
+
+        names.push_back("sparse-dense-unstable-unsorted");
+        AlignedVector<double> sduu_buffer(len);
+        funs.emplace_back([&]() -> double {
+            // Similar to dense-sparse-unstable except that the query is the sparse one.
+            // This means we need to compute the centered ranks for the dense reference.
+            auto ss = centered_ranks(len, full_ref, sduu_buffer.data());
+            const double mult = (ss ? 0.5 / std::sqrt(ss) : 0);
+            const int num = sparse_query_unsorted.size();
+            double l2 = 0;
+            for (int i = 0; i < num; ++i) {
+                const auto& current = sparse_query_unsorted[i];
+                const double target = sduu_buffer[current.first] * mult;
+                const double query = current.second - zero_query;
+                l2 += query * (query - 2 * target);
+            }
+            const double x2 = (num == 0 ? 0 : 0.25);
+            return x2 + l2 - len * zero_query * zero_query;
+        });
+
+        names.push_back("sparse-sparse-interleaved");
+        std::vector<std::pair<int, double> > ssi_tmp;
+        ssi_tmp.reserve(len);
+        funs.emplace_back([&]() -> double {
+            double zero_ref;
+            scaled_ranks(
+                len,
+                negative_ref,
+                positive_ref,
+                ssi_tmp,
+                [&](const double zval) -> void {
+                    zero_ref = zval;
+                },
+                [&](std::pair<int, double>& pair, const double val) -> void {
+                    pair.second = val;
+                }
+            );
+            std::sort(ssi_tmp.begin(), ssi_tmp.end());
+
+            double l2 = 0;
+            int i1 = 0, i2 = 0;
+            int both = 0;
+            const int snum1 = sparse_query.size();
+            const int snum2 = ssi_tmp.size();
+
+            if (i1 < snum1 && i2 < snum2) { 
+                while (1) {
+                    const auto idx1 = sparse_query[i1].first;
+                    const auto idx2 = ssi_tmp[i2].first;
+                    if (idx1 < idx2) {
+                        const double delta = sparse_query[i1].second - zero_ref;
+                        l2 += delta * delta;
+                        ++i1;
+                        if (i1 == snum1) {
+                            break;
+                        }
+                    } else if (idx1 > idx2) {
+                        const double delta = ssi_tmp[i2].second - zero_query;
+                        l2 += delta * delta;
+                        ++i2;
+                        if (i2 == snum2) {
+                            break;
+                        }
+                    } else {
+                        const double delta = sparse_query[i1].second - ssi_tmp[i2].second;
+                        l2 += delta * delta;
+                        ++i1;
+                        ++i2;
+                        ++both;
+                        if (i1 == snum1 || i2 == snum2) {
+                            break;
+                        }
                     }
                 }
             }
-        }
 
-        for (; i1 < snum1; ++i1) { 
-            const double delta = sparse_query[i1].second - zero_ref;
-            l2 += delta * delta;
-        }
-        for (; i2 < snum2; ++i2) { 
-            const double delta = ssi_tmp[i2].second - zero_query;
-            l2 += delta * delta;
-        }
+            for (; i1 < snum1; ++i1) { 
+                const double delta = sparse_query[i1].second - zero_ref;
+                l2 += delta * delta;
+            }
+            for (; i2 < snum2; ++i2) { 
+                const double delta = ssi_tmp[i2].second - zero_query;
+                l2 += delta * delta;
+            }
 
-        const double delta = zero_query - zero_ref;
-        l2 += (len - snum1 - (snum2 - both)) * (delta * delta);
-        return l2;
-    });
+            const double delta = zero_query - zero_ref;
+            l2 += (len - snum1 - (snum2 - both)) * (delta * delta);
+            return l2;
+        });
+
+        // Same as dense-dense and dense-sparse-unstable, but with the structure-of-arrays inputs.
+        names.push_back("dense-dense-soa");
+        AlignedVector<double> dds_buffer(len);
+        funs.emplace_back([&]() -> double {
+            double l2 = 0;
+            scaled_ranks(
+                len,
+                full_ref_soa,
+                dds_buffer.data(),
+                [&](const int i, const double val) -> void {
+                    const double delta = dense_query[i] - val;
+                    l2 += delta * delta;
+                }
+            );
+            return l2;
+        });
+
+        names.push_back("dense-sparse-unstable-soa");
+        std::vector<std::pair<int, double> > asus_tmp;
+        asus_tmp.reserve(len);
+        funs.emplace_back([&]() -> double {
+            double l2 = 0, zero_ref;
+            bool has_nonzero = scaled_ranks(
+                len,
+                negative_ref_soa,
+                positive_ref_soa,
+                asus_tmp,
+                [&](const double zval) -> void {
+                    zero_ref = zval;
+                },
+                [&](std::pair<int, double>& pair, const double val) -> void {
+                    const double target = dense_query[pair.first];
+                    const double ref = val - zero_ref;
+                    l2 += ref * (ref - 2 * target);
+                }
+            );
+            return (has_nonzero ? 0.25 : 0) + l2 - len * zero_ref * zero_ref;
+        });
+
+        // Same as dense-dense and dense-sparse-unstable, but with the vectorized tie detection.
+        names.push_back("dense-dense-tiemask");
+        AlignedVector<double> ddt_buffer(len);
+        funs.emplace_back([&]() -> double {
+            double l2 = 0;
+            scaled_ranks_tiemask(
+                len,
+                full_ref,
+                ddt_buffer.data(),
+                [&](const int i, const double val) -> void {
+                    const double delta = dense_query[i] - val;
+                    l2 += delta * delta;
+                }
+            );
+            return l2;
+        });
+
+        names.push_back("dense-sparse-unstable-tiemask");
+        std::vector<std::pair<int, double> > asut_tmp;
+        asut_tmp.reserve(len);
+        funs.emplace_back([&]() -> double {
+            double l2 = 0, zero_ref;
+            bool has_nonzero = scaled_ranks_tiemask(
+                len,
+                negative_ref,
+                positive_ref,
+                asut_tmp,
+                [&](const double zval) -> void {
+                    zero_ref = zval;
+                },
+                [&](std::pair<int, double>& pair, const double val) -> void {
+                    const double target = dense_query[pair.first];
+                    const double ref = val - zero_ref;
+                    l2 += ref * (ref - 2 * target);
+                }
+            );
+            return (has_nonzero ? 0.25 : 0) + l2 - len * zero_ref * zero_ref;
+        });
+
+        names.push_back("dense-sparse-soa-tiemask");
+        std::vector<std::pair<int, double> > asust_tmp;
+        asust_tmp.reserve(len);
+        funs.emplace_back([&]() -> double {
+            double l2 = 0, zero_ref;
+            bool has_nonzero = scaled_ranks_tiemask(
+                len,
+                negative_ref_soa,
+                positive_ref_soa,
+                asust_tmp,
+                [&](const double zval) -> void {
+                    zero_ref = zval;
+                },
+                [&](std::pair<int, double>& pair, const double val) -> void {
+                    const double target = dense_query[pair.first];
+                    const double ref = val - zero_ref;
+                    l2 += ref * (ref - 2 * target);
+                }
+            );
+            return (has_nonzero ? 0.25 : 0) + l2 - len * zero_ref * zero_ref;
+        });
+
+        // Same as dense-sparse-unstable, but with a single array for the negative and positive values.
+        names.push_back("dense-sparse-unstable-compact");
+        std::vector<std::pair<int, double> > asuc_tmp;
+        asuc_tmp.reserve(len);
+        funs.emplace_back([&]() -> double {
+            double l2 = 0, zero_ref;
+            bool has_nonzero = scaled_ranks(
+                len,
+                compact_ref,
+                asuc_tmp,
+                [&](const double zval) -> void {
+                    zero_ref = zval;
+                },
+                [&](std::pair<int, double>& pair, const double val) -> void {
+                    const double target = dense_query[pair.first];
+                    const double ref = val - zero_ref;
+                    l2 += ref * (ref - 2 * target);
+                }
+            );
+            return (has_nonzero ? 0.25 : 0) + l2 - len * zero_ref * zero_ref;
+        });
 
-    // Performing the iterations.
-    auto res = eztimer::time<double>(
-        funs,
-        [&](const double& res, std::size_t i) -> void {
+        // Performing the iterations.
+        auto check = [&](const double& res, std::size_t i) -> void {
             if (result.has_value()) {
                 if (std::abs(*result - res) / res > 1e-8) {
                     std::cout << *result << "\t" << res << "\t" << names[i] << std::endl;
@@ -392,16 +649,49 @@ int main(int argc, char ** argv) {
             } else {
                 result = res;
             }
-        },
-        opt
-    );
-
-    for (std::size_t n = 0; n < names.size(); ++n) {
-        std::string nn = names[n];
-        nn.resize(32, ' ');
-        const double mu = res[n].mean.count(); 
-        const double se = res[n].sd.count() / std::sqrt(res[n].times.size());
-        std::cout << nn << ": " << mu << " ± " << (se / mu * 100) << " %" << std::endl;
+        };
+
+        auto report = [&](const auto& res) -> void {
+            for (std::size_t n = 0; n < names.size(); ++n) {
+                std::string nn = names[n];
+                nn.resize(32, ' ');
+                const double mu = res[n].mean.count(); 
+                const double se = res[n].sd.count() / std::sqrt(res[n].times.size());
+                std::cout << nn << ": " << mu << " ± " << (se / mu * 100) << " %" << std::endl;
+            }
+        };
+
+        if (allocations || forbid_allocations) {
+            // All kernels here are meant to be allocation-free once their buffers have been reserved.
+            // This is done before the timings so that the buffers have not yet been grown by any earlier calls.
+            auto counts = count_allocations(funs, opt.setup, iterations);
+            std::cout << "Allocations per call:" << std::endl;
+            bool any_allocated = false;
+            for (std::size_t n = 0; n < names.size(); ++n) {
+                std::string nn = names[n];
+                nn.resize(32, ' ');
+                std::cout << nn << ": " << counts[n].calls << " (" << counts[n].bytes << " bytes)" << std::endl;
+                any_allocated = any_allocated || counts[n].calls > 0;
+            }
+            if (forbid_allocations && any_allocated) {
+                throw std::runtime_error("kernels should not allocate in the steady state");
+            }
+            std::cout << std::endl;
+        }
+
+        if (precise) {
+            BatchOptions bopt;
+            bopt.iterations = iterations;
+            bopt.setup = opt.setup;
+            bopt.target = target;
+            report(batch_time<double>(funs, check, bopt));
+        } else {
+            report(eztimer::time<double>(funs, check, opt));
+        }
+
+        if (lengths.size() > 1) {
+            std::cout << std::endl;
+        }
     }
 
     return 0;
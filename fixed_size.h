@@ -0,0 +1,172 @@
+#ifndef FIXED_SIZE_H
+#define FIXED_SIZE_H
+
+#include <algorithm>
+#include <limits>
+#include <type_traits>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+
+// Rank and L2 routines for small numbers of markers, as seen in the later rounds of fine-tuning.
+// Each routine is templated on a compile-time size so that the compiler can fully unroll and vectorize the loops,
+// with the actual number of markers padded up to the next supported size.
+template<class Function_>
+bool dispatch_fixed_size(const int num_markers, Function_ fun) {
+    if (num_markers <= 16) {
+        fun(std::integral_constant<int, 16>());
+    } else if (num_markers <= 32) {
+        fun(std::integral_constant<int, 32>());
+    } else if (num_markers <= 64) {
+        fun(std::integral_constant<int, 64>());
+    } else if (num_markers <= 128) {
+        fun(std::integral_constant<int, 128>());
+    } else if (num_markers <= 256) {
+        fun(std::integral_constant<int, 256>());
+    } else {
+        return false;
+    }
+    return true;
+}
+
+constexpr int max_fixed_size = 256;
+
+// The O(n log^2 n) compare-exchanges of the bitonic network eventually lose to std::sort's O(n log n) comparisons,
+// so larger sizes just use std::sort on a fixed-size array.
+constexpr int max_network_size = 64;
+
+// Counting ranks is O(n^2), so it eventually loses to sorting even with SIMD.
+constexpr int max_counting_size = 128;
+
+// One stage of the bitonic network, where each element is compared to the element 'Stride_' positions away.
+// We loop over all compare-exchanges in a single loop with a per-pair direction, so that even the small strides can be vectorized.
+// We use min/max for the values and XOR masks for the indices to ensure that the compiler does not emit any branches.
+template<int Size_, int Block_, int Stride_>
+void bitonic_stage(double* __restrict values, std::int64_t* __restrict indices) {
+    for (int m = 0; m < Size_ / 2; ++m) {
+        const int i = (m / Stride_) * 2 * Stride_ + (m % Stride_);
+        const bool ascending = ((i & Block_) == 0);
+        const double left = values[i], right = values[i + Stride_];
+        const double smaller = std::min(left, right), larger = std::max(left, right);
+        const bool swap = (left > right) == ascending;
+        const std::int64_t diff = (indices[i] ^ indices[i + Stride_]) & -static_cast<std::int64_t>(swap);
+        values[i] = (ascending ? smaller : larger);
+        values[i + Stride_] = (ascending ? larger : smaller);
+        indices[i] ^= diff;
+        indices[i + Stride_] ^= diff;
+    }
+    if constexpr (Stride_ > 1) {
+        bitonic_stage<Size_, Block_, Stride_ / 2>(values, indices);
+    }
+}
+
+// Sorts the values in increasing order, permuting the indices in the same manner.
+// All loop bounds are compile-time constants so that the compiler can unroll the small strides.
+template<int Size_, int Block_ = 2>
+void bitonic_sort(double* values, std::int64_t* indices) {
+    static_assert((Size_ & (Size_ - 1)) == 0, "size should be a power of two");
+    bitonic_stage<Size_, Block_, Block_ / 2>(values, indices);
+    if constexpr (Block_ < Size_) {
+        bitonic_sort<Size_, Block_ * 2>(values, indices);
+    }
+}
+
+// Computes scaled ranks from the unsorted values of the first 'num_markers' markers, storing them in 'output'.
+// 'output' should have space for Size_ entries, where the padding entries are set to zero so that they do not contribute to fixed_l2().
+// Returns false for no-variance profiles, which are left as all-zero scaled ranks as in scaled_ranks().
+//
+// With AVX2 or AVX-512, we don't sort at all for sizes up to max_counting_size.
+// The mean rank of each value's ties is just the number of smaller values plus half the number of other equal values, and counting these for all pairs is O(n^2) but vectorizes perfectly as the inner loop has a compile-time trip count and no branches.
+// The padding entries are set to NaN, which is never smaller than or equal to anything, so they cannot collide with any input value.
+//
+// Otherwise, the counting loop is too slow, so we sort with the bitonic network (up to max_network_size) or std::sort().
+// In this case, the network pads with +infinity, so the input values must be finite; they must not be NaN in any case, as for scaled_ranks().
+template<int Size_>
+bool fixed_scaled_ranks(const int num_markers, const double* raw, double* output) {
+    const double center_rank = static_cast<double>(num_markers - 1) / static_cast<double>(2);
+    double sum_squares = 0;
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+    constexpr bool use_counting = (Size_ <= max_counting_size);
+#else
+    constexpr bool use_counting = false;
+#endif
+
+    double values[Size_];
+    if constexpr (use_counting) {
+        for (int i = 0; i < Size_; ++i) {
+            values[i] = (i < num_markers ? raw[i] : std::numeric_limits<double>::quiet_NaN());
+        }
+
+        for (int i = 0; i < num_markers; ++i) {
+            const double current = values[i];
+            // Twice the mean rank of the ties, i.e., 2 * (number smaller) + (number equal - 1).
+            std::int64_t doubled = -1;
+            for (int j = 0; j < Size_; ++j) {
+                doubled += static_cast<std::int64_t>(values[j] < current) * 2 + static_cast<std::int64_t>(values[j] == current);
+            }
+            const double mean_rank = static_cast<double>(doubled) / 2 - center_rank;
+            output[i] = mean_rank;
+            sum_squares += mean_rank * mean_rank;
+        }
+    } else {
+        std::int64_t indices[Size_];
+        if constexpr (Size_ <= max_network_size) {
+            for (int i = 0; i < Size_; ++i) {
+                values[i] = (i < num_markers ? raw[i] : std::numeric_limits<double>::infinity());
+                indices[i] = i;
+            }
+            bitonic_sort<Size_>(values, indices);
+        } else {
+            std::pair<double, int> sorted[Size_];
+            for (int i = 0; i < num_markers; ++i) {
+                sorted[i].first = raw[i];
+                sorted[i].second = i;
+            }
+            std::sort(sorted, sorted + num_markers);
+            for (int i = 0; i < num_markers; ++i) {
+                values[i] = sorted[i].first;
+                indices[i] = sorted[i].second;
+            }
+        }
+
+        int cur_rank = 0;
+        while (cur_rank < num_markers) {
+            int copy = cur_rank;
+            do {
+                ++copy;
+            } while (copy < num_markers && values[copy] == values[cur_rank]);
+
+            const double jump = copy - cur_rank;
+            const double mean_rank = cur_rank + (jump - 1) / static_cast<double>(2) - center_rank;
+            sum_squares += mean_rank * mean_rank * jump;
+            for (; cur_rank < copy; ++cur_rank) {
+                output[indices[cur_rank]] = mean_rank;
+            }
+        }
+    }
+
+    std::fill(output + num_markers, output + Size_, 0);
+    if (sum_squares == 0) {
+        std::fill(output, output + num_markers, 0);
+        return false;
+    }
+
+    const double denom = 0.5 / std::sqrt(sum_squares);
+    for (int i = 0; i < Size_; ++i) {
+        output[i] *= denom;
+    }
+    return true;
+}
+
+template<int Size_>
+double fixed_l2(const double* left, const double* right) {
+    double l2 = 0;
+    for (int i = 0; i < Size_; ++i) {
+        const double delta = left[i] - right[i];
+        l2 += delta * delta;
+    }
+    return l2;
+}
+
+#endif
@@ -0,0 +1,153 @@
+#ifndef HARNESS_H
+#define HARNESS_H
+
+#include <algorithm>
+#include <vector>
+#include <functional>
+#include <chrono>
+#include <random>
+#include <cmath>
+#include <cstdint>
+#include <atomic>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HARNESS_USE_RDTSC
+#endif
+
+// High-resolution alternative to eztimer::time() for kernels that run in less than a microsecond.
+// Each timed sample runs a kernel K times in a row, where K is calibrated so that a sample takes at least BatchOptions::target seconds.
+// The cost of an empty call with the same batch size is then subtracted to remove the std::function dispatch and clock overhead.
+struct BatchOptions {
+    int iterations = 100;
+    std::function<void()> setup;
+    double target = 1e-4;
+    int max_batch = 1 << 20;
+    int overhead_samples = 21;
+};
+
+struct BatchTimings {
+    std::chrono::duration<double> mean, sd;
+    std::vector<std::chrono::duration<double> > times;
+    int batch = 1;
+    std::chrono::duration<double> overhead;
+};
+
+inline std::uint64_t read_ticks() {
+#ifdef HARNESS_USE_RDTSC
+    // rdtscp waits for all previous instructions to finish; the fence stops later instructions from starting early.
+    unsigned int aux;
+    const std::uint64_t ticks = __rdtscp(&aux);
+    _mm_lfence();
+    return ticks;
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+inline double seconds_per_tick() {
+#ifdef HARNESS_USE_RDTSC
+    // Calibrating the TSC frequency against the steady clock, which only needs to be done once.
+    static const double spt = []() -> double {
+        const auto start_time = std::chrono::steady_clock::now();
+        const auto start_ticks = read_ticks();
+        while (std::chrono::steady_clock::now() - start_time < std::chrono::milliseconds(50)) {}
+        const auto end_ticks = read_ticks();
+        const auto end_time = std::chrono::steady_clock::now();
+        return std::chrono::duration<double>(end_time - start_time).count() / static_cast<double>(end_ticks - start_ticks);
+    }();
+    return spt;
+#else
+    return 1e-9;
+#endif
+}
+
+template<typename Output_>
+double time_batch(const std::function<Output_()>& fun, const int batch, Output_& output) {
+    const auto start = read_ticks();
+    for (int k = 0; k < batch; ++k) {
+        output = fun();
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+    }
+    const auto end = read_ticks();
+    return static_cast<double>(end - start) * seconds_per_tick();
+}
+
+template<typename Output_>
+std::vector<BatchTimings> batch_time(
+    const std::vector<std::function<Output_()> >& funs,
+    const std::function<void(const Output_&, std::size_t)>& check,
+    const BatchOptions& options
+) {
+    const std::size_t nfuns = funs.size();
+    std::vector<BatchTimings> output(nfuns);
+    Output_ tmp;
+
+    // Calibrating the batch size for each kernel on the first simulated dataset.
+    if (options.setup) {
+        options.setup();
+    }
+    for (std::size_t f = 0; f < nfuns; ++f) {
+        auto& batch = output[f].batch;
+        while (batch < options.max_batch && time_batch(funs[f], batch, tmp) < options.target) {
+            batch *= 2;
+        }
+    }
+
+    // Measuring the overhead of an empty call with the same batch size, using the median to ignore interruptions.
+    const std::function<Output_()> empty = []() -> Output_ { return Output_(); };
+    std::vector<double> overhead_times(options.overhead_samples);
+    for (std::size_t f = 0; f < nfuns; ++f) {
+        const int batch = output[f].batch;
+        for (auto& o : overhead_times) {
+            o = time_batch(empty, batch, tmp) / batch;
+        }
+        const std::size_t mid = overhead_times.size() / 2;
+        std::nth_element(overhead_times.begin(), overhead_times.begin() + mid, overhead_times.end());
+        output[f].overhead = std::chrono::duration<double>(overhead_times[mid]);
+    }
+
+    std::vector<std::size_t> order(nfuns);
+    for (std::size_t f = 0; f < nfuns; ++f) {
+        order[f] = f;
+    }
+    std::mt19937_64 rng(nfuns);
+
+    for (int it = 0; it < options.iterations; ++it) {
+        if (options.setup) {
+            options.setup();
+        }
+        std::shuffle(order.begin(), order.end(), rng);
+
+        for (auto f : order) {
+            auto& current = output[f];
+            const double elapsed = time_batch(funs[f], current.batch, tmp) / current.batch - current.overhead.count();
+            check(tmp, f);
+            current.times.emplace_back(std::max(elapsed, 0.0));
+        }
+    }
+
+    for (auto& current : output) {
+        double mean = 0;
+        for (const auto& t : current.times) {
+            mean += t.count();
+        }
+        mean /= current.times.size();
+
+        double var = 0;
+        for (const auto& t : current.times) {
+            const double delta = t.count() - mean;
+            var += delta * delta;
+        }
+        if (current.times.size() > 1) {
+            var /= current.times.size() - 1;
+        }
+
+        current.mean = std::chrono::duration<double>(mean);
+        current.sd = std::chrono::duration<double>(std::sqrt(var));
+    }
+
+    return output;
+}
+
+#endif
@@ -0,0 +1,157 @@
+#ifndef HUGE_PAGES_H
+#define HUGE_PAGES_H
+
+#include <vector>
+#include <algorithm>
+#include <string>
+#include <new>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+// Allocation of large buffers on 2 MB boundaries, with a request for the kernel to back them with transparent huge pages.
+// This reduces TLB pressure for random gathers into large buffers, e.g., the dense query or dense references in the sparse kernels.
+// If transparent huge pages are disabled or unsupported, madvise() fails (or is skipped on non-Linux systems) and we silently use normal pages;
+// use huge_page_bytes() to check how much of a buffer is actually backed by huge pages.
+constexpr std::size_t huge_page_size = 2 * 1024 * 1024;
+
+inline void* allocate_huge_pages(std::size_t bytes) {
+    bytes = (bytes + huge_page_size - 1) / huge_page_size * huge_page_size;
+    void* ptr = std::aligned_alloc(huge_page_size, bytes);
+    if (ptr == NULL) {
+        throw std::bad_alloc();
+    }
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    madvise(ptr, bytes, MADV_HUGEPAGE);
+#endif
+    return ptr;
+}
+
+inline void deallocate_huge_pages(void* ptr) {
+    std::free(ptr);
+}
+
+template<typename T>
+struct HugePageAllocator {
+    typedef T value_type;
+
+    HugePageAllocator() = default;
+
+    template<typename U>
+    HugePageAllocator(const HugePageAllocator<U>&) {}
+
+    T* allocate(const std::size_t n) {
+        return static_cast<T*>(allocate_huge_pages(n * sizeof(T)));
+    }
+
+    void deallocate(T* ptr, const std::size_t) {
+        deallocate_huge_pages(ptr);
+    }
+
+    template<typename U>
+    bool operator==(const HugePageAllocator<U>&) const {
+        return true;
+    }
+
+    template<typename U>
+    bool operator!=(const HugePageAllocator<U>&) const {
+        return false;
+    }
+};
+
+template<typename T>
+using HugePageVector = std::vector<T, HugePageAllocator<T> >;
+
+// Counterpart to allocate_huge_pages() for the baseline, where we ask the kernel to never use huge pages for the buffer.
+// Otherwise, with transparent huge pages in "always" mode, the supposedly normal buffers might also be backed by huge pages.
+// This is done before the buffer is first touched, as madvise() does not split any huge pages that were already faulted in.
+constexpr std::size_t small_page_size = 4096;
+
+inline void* allocate_small_pages(std::size_t bytes) {
+    bytes = (bytes + small_page_size - 1) / small_page_size * small_page_size;
+    void* ptr = std::aligned_alloc(small_page_size, bytes);
+    if (ptr == NULL) {
+        throw std::bad_alloc();
+    }
+#if defined(__linux__) && defined(MADV_NOHUGEPAGE)
+    madvise(ptr, bytes, MADV_NOHUGEPAGE);
+#endif
+    return ptr;
+}
+
+template<typename T>
+struct SmallPageAllocator {
+    typedef T value_type;
+
+    SmallPageAllocator() = default;
+
+    template<typename U>
+    SmallPageAllocator(const SmallPageAllocator<U>&) {}
+
+    T* allocate(const std::size_t n) {
+        return static_cast<T*>(allocate_small_pages(n * sizeof(T)));
+    }
+
+    void deallocate(T* ptr, const std::size_t) {
+        std::free(ptr);
+    }
+
+    template<typename U>
+    bool operator==(const SmallPageAllocator<U>&) const {
+        return true;
+    }
+
+    template<typename U>
+    bool operator!=(const SmallPageAllocator<U>&) const {
+        return false;
+    }
+};
+
+template<typename T>
+using SmallPageVector = std::vector<T, SmallPageAllocator<T> >;
+
+// Current transparent huge page mode, e.g., "always [madvise] never", or an empty string if it could not be determined.
+inline std::string transparent_huge_page_mode() {
+    std::ifstream handle("/sys/kernel/mm/transparent_hugepage/enabled");
+    std::string mode;
+    std::getline(handle, mode);
+    return mode;
+}
+
+// Number of bytes backed by anonymous huge pages in all mappings that overlap with the specified buffer, according to /proc/self/smaps.
+// This may slightly overestimate if other allocations share the same mappings, but that's not a concern for multi-MB buffers.
+// We cap the result at 'bytes' as the mapping also includes the rounding up to the next huge page.
+// Returns zero on non-Linux systems.
+inline std::size_t huge_page_bytes(const void* ptr, const std::size_t bytes) {
+    std::ifstream handle("/proc/self/smaps");
+    const auto first = reinterpret_cast<std::uintptr_t>(ptr), last = first + bytes;
+    bool overlapping = false;
+    std::size_t total = 0;
+
+    std::string line;
+    while (std::getline(handle, line)) {
+        // Mapping headers look like "7f0000000000-7f0000200000 rw-p ...", while the fields look like "AnonHugePages:  2048 kB".
+        const auto dash = line.find('-');
+        const auto space = line.find(' ');
+        if (dash != std::string::npos && dash < space && line.find(':') > space) {
+            const auto start = std::stoull(line.substr(0, dash), NULL, 16);
+            const auto end = std::stoull(line.substr(dash + 1, space - dash - 1), NULL, 16);
+            overlapping = (start < last && first < end);
+        } else if (overlapping && line.rfind("AnonHugePages:", 0) == 0) {
+            std::istringstream fields(line.substr(14));
+            std::size_t kb = 0;
+            fields >> kb;
+            total += kb * 1024;
+        }
+    }
+
+    return std::min(total, bytes);
+}
+
+#endif
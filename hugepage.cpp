@@ -0,0 +1,221 @@
+#include "eztimer/eztimer.hpp"
+
+#include "CLI/App.hpp"
+#include "CLI/Formatter.hpp"
+#include "CLI/Config.hpp"
+
+#include "scaled_ranks.h"
+#include "simulate.h"
+#include "l2_kernels.h"
+#include "huge_pages.h"
+#include "perf_counters.h"
+
+#include <random>
+#include <vector>
+#include <optional>
+#include <iostream>
+#include <algorithm>
+
+// Large buffers for the query and references, allocated with either normal or huge pages.
+template<template<typename> class Vector_>
+struct Workload {
+    Vector_<double> dense_query;
+    Vector_<double> dense_refs;
+    Vector_<int> sparse_ref_index;
+    Vector_<double> sparse_ref_value;
+    std::vector<std::size_t> sparse_ref_start;
+    std::vector<double> zero_refs;
+};
+
+template<template<typename> class Vector_, template<typename> class Other_>
+void copy_workload(const Workload<Other_>& source, Workload<Vector_>& destination) {
+    destination.dense_query.assign(source.dense_query.begin(), source.dense_query.end());
+    destination.dense_refs.assign(source.dense_refs.begin(), source.dense_refs.end());
+    destination.sparse_ref_index.assign(source.sparse_ref_index.begin(), source.sparse_ref_index.end());
+    destination.sparse_ref_value.assign(source.sparse_ref_value.begin(), source.sparse_ref_value.end());
+    destination.sparse_ref_start = source.sparse_ref_start;
+    destination.zero_refs = source.zero_refs;
+}
+
+// Each function returns a weighted sum of the L2 distances to all references.
+template<template<typename> class Vector_>
+double compute_dense_sparse(const int len, const Workload<Vector_>& work) {
+    double total = 0;
+    const int nrefs = work.zero_refs.size();
+    for (int r = 0; r < nrefs; ++r) {
+        const auto start = work.sparse_ref_start[r];
+        const int num = work.sparse_ref_start[r + 1] - start;
+        total += dense_sparse_unstable(len, work.dense_query.data(), num, work.sparse_ref_index.data() + start, work.sparse_ref_value.data() + start, work.zero_refs[r]) * (r + 1);
+    }
+    return total;
+}
+
+template<template<typename> class Vector_>
+double compute_sparse_dense(const int len, const std::vector<std::pair<int, double> >& sparse_query, const double zero_query, const Workload<Vector_>& work) {
+    double total = 0;
+    const int nrefs = work.zero_refs.size();
+    const std::size_t stride = len;
+    for (int r = 0; r < nrefs; ++r) {
+        total += sparse_dense_unstable(len, sparse_query.size(), sparse_query.data(), zero_query, work.dense_refs.data() + stride * r) * (r + 1);
+    }
+    return total;
+}
+
+template<typename Vector_>
+void report_backing(const std::string& name, const Vector_& buffer) {
+    constexpr double mb = 1024 * 1024;
+    const std::size_t bytes = buffer.size() * sizeof(typename Vector_::value_type);
+    std::cout << "  " << name << ": " << huge_page_bytes(buffer.data(), bytes) / mb << " of " << bytes / mb << " MB in huge pages" << std::endl;
+}
+
+int main(int argc, char ** argv) {
+    CLI::App app{"Huge page performance tests for large working sets"};
+    int len;
+    app.add_option("-l,--length", len, "Length of the simulated vector")->default_val(1000000);
+    double density;
+    app.add_option("-d,--density", density, "Density of non-zero elements in the simulated vector")->default_val(0.05);
+    int nrefs;
+    app.add_option("-n,--references", nrefs, "Number of references")->default_val(100);
+    int iterations;
+    app.add_option("-i,--iter", iterations, "Number of iterations")->default_val(10);
+    unsigned long long seed;
+    app.add_option("-s,--seed", seed, "Seed for the simulated data")->default_val(69);
+    CLI11_PARSE(app, argc, argv);
+
+    std::mt19937_64 rng(seed);
+    RankedVector negative, positive;
+    std::vector<std::pair<int, double> > buffer;
+    buffer.reserve(len);
+
+    // Simulating the references in both sparse and dense form, and then copying them into the huge page buffers.
+    Workload<SmallPageVector> normal;
+    Workload<HugePageVector> huge;
+    {
+        const std::size_t stride = len;
+        normal.dense_refs.resize(stride * nrefs);
+        normal.sparse_ref_start.push_back(0);
+        for (int r = 0; r < nrefs; ++r) {
+            simulate_sparse(len, density, rng, negative, positive);
+            double zero_ref;
+            scaled_ranks(len, negative, positive, buffer, zero_ref);
+            std::sort(buffer.begin(), buffer.end());
+
+            double* dense = normal.dense_refs.data() + stride * r;
+            std::fill_n(dense, len, zero_ref);
+            for (const auto& b : buffer) {
+                dense[b.first] = b.second;
+                normal.sparse_ref_index.push_back(b.first);
+                normal.sparse_ref_value.push_back(b.second);
+            }
+            normal.sparse_ref_start.push_back(normal.sparse_ref_index.size());
+            normal.zero_refs.push_back(zero_ref);
+        }
+        normal.dense_query.resize(len);
+        copy_workload(normal, huge);
+    }
+
+    // Reporting both sets of buffers, to check that the normal buffers are not also backed by huge pages (e.g., in "always" mode).
+    std::cout << "Transparent huge pages: " << transparent_huge_page_mode() << std::endl;
+    std::cout << "Normal buffers:" << std::endl;
+    report_backing("dense query", normal.dense_query);
+    report_backing("dense references", normal.dense_refs);
+    report_backing("sparse reference indices", normal.sparse_ref_index);
+    report_backing("sparse reference values", normal.sparse_ref_value);
+    std::cout << "Huge page buffers:" << std::endl;
+    report_backing("dense query", huge.dense_query);
+    report_backing("dense references", huge.dense_refs);
+    report_backing("sparse reference indices", huge.sparse_ref_index);
+    report_backing("sparse reference values", huge.sparse_ref_value);
+    std::cout << std::endl;
+
+    // Simulating the query in the setup, in dense form and in sparse form with the entries in random order.
+    std::vector<std::pair<int, double> > sparse_query_unsorted;
+    double zero_query;
+    std::optional<double> dense_sparse_result, sparse_dense_result;
+
+    eztimer::Options opt;
+    opt.iterations = iterations;
+    opt.setup = [&]() -> void {
+        simulate_sparse(len, density, rng, negative, positive);
+        scaled_ranks(len, negative, positive, sparse_query_unsorted, zero_query);
+        std::fill(normal.dense_query.begin(), normal.dense_query.end(), zero_query);
+        for (const auto& sq : sparse_query_unsorted) {
+            normal.dense_query[sq.first] = sq.second;
+        }
+        std::copy(normal.dense_query.begin(), normal.dense_query.end(), huge.dense_query.begin());
+        std::shuffle(sparse_query_unsorted.begin(), sparse_query_unsorted.end(), rng);
+        dense_sparse_result.reset();
+        sparse_dense_result.reset();
+    };
+
+    std::vector<std::function<double()> > funs;
+    std::vector<std::string> names;
+
+    names.push_back("dense-sparse-unstable-4k");
+    funs.emplace_back([&]() -> double {
+        return compute_dense_sparse(len, normal);
+    });
+
+    names.push_back("dense-sparse-unstable-huge");
+    funs.emplace_back([&]() -> double {
+        return compute_dense_sparse(len, huge);
+    });
+
+    names.push_back("sparse-dense-unsorted-4k");
+    funs.emplace_back([&]() -> double {
+        return compute_sparse_dense(len, sparse_query_unsorted, zero_query, normal);
+    });
+
+    names.push_back("sparse-dense-unsorted-huge");
+    funs.emplace_back([&]() -> double {
+        return compute_sparse_dense(len, sparse_query_unsorted, zero_query, huge);
+    });
+
+    auto res = eztimer::time<double>(
+        funs,
+        [&](const double& res, std::size_t i) -> void {
+            // The two kernel types accumulate in different orders, so we only compare within each type.
+            auto& result = (i < 2 ? dense_sparse_result : sparse_dense_result);
+            if (result.has_value()) {
+                if (std::abs(*result - res) > 1e-8 * std::abs(res)) {
+                    std::cout << *result << "\t" << res << "\t" << names[i] << std::endl;
+                    throw std::runtime_error("oops that's not right");
+                }
+            } else {
+                result = res;
+            }
+        },
+        opt
+    );
+
+    for (std::size_t n = 0; n < names.size(); ++n) {
+        std::string nn = names[n];
+        nn.resize(32, ' ');
+        const double mu = res[n].mean.count();
+        const double se = res[n].sd.count() / std::sqrt(res[n].times.size());
+        std::cout << nn << ": " << mu << " ± " << (se / mu * 100) << " %" << std::endl;
+    }
+
+    // Reporting the dTLB misses per call and the miss rate, if available.
+    PerfCounters counters({ PerfEvent::DTLB_READS, PerfEvent::DTLB_READ_MISSES });
+    std::cout << std::endl;
+    if (!counters.available()) {
+        std::cout << "Hardware counters are not available" << std::endl;
+    } else {
+        for (std::size_t n = 0; n < names.size(); ++n) {
+            opt.setup();
+            counters.start();
+            for (int it = 0; it < iterations; ++it) {
+                funs[n]();
+            }
+            const auto counts = counters.stop();
+
+            std::string nn = names[n];
+            nn.resize(32, ' ');
+            const double reads = counts[0], misses = counts[1];
+            std::cout << nn << ": dTLB-read-misses = " << misses / iterations << ", miss rate = " << (reads ? misses / reads * 100 : 0) << " %" << std::endl;
+        }
+    }
+
+    return 0;
+}
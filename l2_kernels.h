@@ -0,0 +1,191 @@
+#ifndef L2_KERNELS_H
+#define L2_KERNELS_H
+
+#include <algorithm>
+#include <utility>
+
+// Standalone versions of the kernels in basic.cpp, for use by the other benchmarks.
+// These operate on raw pointers so that they can be applied to any storage, e.g., memory-mapped references.
+
+inline double dense_dense(const int num_markers, const double* dense_query, const double* dense_ref) {
+    double l2 = 0;
+    for (int i = 0; i < num_markers; ++i) {
+        const double delta = dense_query[i] - dense_ref[i];
+        l2 += delta * delta;
+    }
+    return l2;
+}
+
+inline double sparse_dense_interleaved(
+    const int num_markers,
+    const int num_query,
+    const std::pair<int, double>* sparse_query,
+    const double zero_query,
+    const double* dense_ref
+) {
+    int i = 0, j = 0;
+    double l2 = 0;
+
+    while (j < num_query) {
+        const auto limit = sparse_query[j].first;
+        for (; i < limit; ++i) {
+            const auto delta = dense_ref[i] - zero_query;
+            l2 += delta * delta;
+        }
+        const auto delta = dense_ref[i] - sparse_query[j].second;
+        l2 += delta * delta;
+        ++i;
+        ++j;
+    }
+
+    for (; i < num_markers; ++i) {
+        const auto delta = dense_ref[i] - zero_query;
+        l2 += delta * delta;
+    }
+
+    return l2;
+}
+
+inline double dense_sparse_interleaved(
+    const int num_markers,
+    const double* dense_query,
+    const int num_nonzero,
+    const int* sparse_ref_index,
+    const double* sparse_ref_value,
+    const double zero_ref
+) {
+    int i = 0, j = 0;
+    double l2 = 0;
+
+    while (j < num_nonzero) {
+        const auto limit = sparse_ref_index[j];
+        for (; i < limit; ++i) {
+            const auto delta = dense_query[i] - zero_ref;
+            l2 += delta * delta;
+        }
+        const auto delta = dense_query[i] - sparse_ref_value[j];
+        l2 += delta * delta;
+        ++i;
+        ++j;
+    }
+
+    for (; i < num_markers; ++i) {
+        const auto delta = dense_query[i] - zero_ref;
+        l2 += delta * delta;
+    }
+
+    return l2;
+}
+
+inline double dense_sparse_densified(
+    const int num_markers,
+    const double* dense_query,
+    const int num_nonzero,
+    const int* sparse_ref_index,
+    const double* sparse_ref_value,
+    const double zero_ref,
+    double* buffer
+) {
+    std::fill_n(buffer, num_markers, zero_ref);
+    for (int i = 0; i < num_nonzero; ++i) {
+        buffer[sparse_ref_index[i]] = sparse_ref_value[i];
+    }
+    return dense_dense(num_markers, dense_query, buffer);
+}
+
+inline double dense_sparse_unstable(
+    const int num_markers,
+    const double* dense_query,
+    const int num_nonzero,
+    const int* sparse_ref_index,
+    const double* sparse_ref_value,
+    const double zero_ref
+) {
+    double l2 = 0;
+    for (int i = 0; i < num_nonzero; ++i) {
+        const double target = dense_query[sparse_ref_index[i]];
+        const double ref = sparse_ref_value[i] - zero_ref;
+        l2 += ref * (ref - 2 * target);
+    }
+    const double x2 = (num_nonzero == 0 ? 0 : 0.25);
+    return x2 + l2 - num_markers * zero_ref * zero_ref;
+}
+
+inline double sparse_dense_unstable(
+    const int num_markers,
+    const int num_query,
+    const std::pair<int, double>* sparse_query,
+    const double zero_query,
+    const double* dense_ref
+) {
+    double l2 = 0;
+    for (int i = 0; i < num_query; ++i) {
+        const auto& current = sparse_query[i];
+        const double target = dense_ref[current.first];
+        const double query = current.second - zero_query;
+        l2 += query * (query - 2 * target);
+    }
+    const double x2 = (num_query == 0 ? 0 : 0.25);
+    return x2 + l2 - num_markers * zero_query * zero_query;
+}
+
+inline double sparse_sparse_interleaved(
+    const int num_markers,
+    const int num_query,
+    const std::pair<int, double>* sparse_query,
+    const double zero_query,
+    const int num_ref,
+    const int* sparse_ref_index,
+    const double* sparse_ref_value,
+    const double zero_ref
+) {
+    double l2 = 0;
+    int i1 = 0, i2 = 0;
+    int both = 0;
+
+    if (i1 < num_query && i2 < num_ref) { 
+        while (1) {
+            const auto idx1 = sparse_query[i1].first;
+            const auto idx2 = sparse_ref_index[i2];
+            if (idx1 < idx2) {
+                const double delta = sparse_query[i1].second - zero_ref;
+                l2 += delta * delta;
+                ++i1;
+                if (i1 == num_query) {
+                    break;
+                }
+            } else if (idx1 > idx2) {
+                const double delta = sparse_ref_value[i2] - zero_query;
+                l2 += delta * delta;
+                ++i2;
+                if (i2 == num_ref) {
+                    break;
+                }
+            } else {
+                const double delta = sparse_query[i1].second - sparse_ref_value[i2];
+                l2 += delta * delta;
+                ++i1;
+                ++i2;
+                ++both;
+                if (i1 == num_query || i2 == num_ref) {
+                    break;
+                }
+            }
+        }
+    }
+
+    for (; i1 < num_query; ++i1) { 
+        const double delta = sparse_query[i1].second - zero_ref;
+        l2 += delta * delta;
+    }
+    for (; i2 < num_ref; ++i2) { 
+        const double delta = sparse_ref_value[i2] - zero_query;
+        l2 += delta * delta;
+    }
+
+    const double delta = zero_query - zero_ref;
+    l2 += (num_markers - num_query - (num_ref - both)) * (delta * delta);
+    return l2;
+}
+
+#endif
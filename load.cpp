@@ -0,0 +1,140 @@
+#include "eztimer/eztimer.hpp"
+
+#include "CLI/App.hpp"
+#include "CLI/Formatter.hpp"
+#include "CLI/Config.hpp"
+
+#include "scaled_ranks.h"
+#include "simulate.h"
+#include "l2_kernels.h"
+#include "reference_file.h"
+
+#include <random>
+#include <vector>
+#include <optional>
+#include <iostream>
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+template<class Block_>
+double score_all(const int len, const Block_& block, const std::vector<double>& dense_query) {
+    double total = 0;
+    const std::size_t nprofiles = block.num_profiles();
+    for (std::size_t p = 0; p < nprofiles; ++p) {
+        total += dense_sparse_unstable(len, dense_query.data(), block.num_nonzero(p), block.profile_index(p), block.profile_value(p), block.profile_zero(p));
+    }
+    return total;
+}
+
+int main(int argc, char ** argv) {
+    CLI::App app{"Reference loading performance tests"};
+    int len;
+    app.add_option("-l,--length", len, "Length of the simulated vector")->default_val(1000);
+    double density;
+    app.add_option("-d,--density", density, "Density of non-zero elements in the simulated vector")->default_val(0.2);
+    int nprofiles;
+    app.add_option("-n,--profiles", nprofiles, "Number of reference profiles")->default_val(10000);
+    int iterations;
+    app.add_option("-i,--iter", iterations, "Number of iterations")->default_val(10);
+    unsigned long long seed;
+    app.add_option("-s,--seed", seed, "Seed for the simulated data")->default_val(69);
+    std::string path;
+    app.add_option("-f,--file", path, "Path to the reference file")->default_val("references.bin");
+    CLI11_PARSE(app, argc, argv);
+
+    // Simulating the raw reference values, which are stored sorted by value as in singlepp.
+    std::mt19937_64 rng(seed);
+    std::vector<RankedVector> negative_refs(nprofiles), positive_refs(nprofiles);
+    for (int p = 0; p < nprofiles; ++p) {
+        simulate_sparse(len, density, rng, negative_refs[p], positive_refs[p]);
+    }
+
+    std::vector<std::pair<int, double> > buffer;
+    buffer.reserve(len);
+    {
+        ReferenceBlock block(len);
+        for (int p = 0; p < nprofiles; ++p) {
+            append_reference(block, negative_refs[p], positive_refs[p], buffer);
+        }
+        save_reference_block(path, block);
+    }
+
+    // Setting up a dense query.
+    RankedVector negative_query, positive_query;
+    std::vector<std::pair<int, double> > sparse_query;
+    sparse_query.reserve(len);
+    double zero_query;
+    std::vector<double> dense_query(len);
+    simulate_sparse(len, density, rng, negative_query, positive_query);
+    scaled_ranks(len, negative_query, positive_query, sparse_query, zero_query);
+    std::fill(dense_query.begin(), dense_query.end(), zero_query);
+    for (const auto& sq : sparse_query) {
+        dense_query[sq.first] = sq.second;
+    }
+
+    std::optional<double> result;
+    eztimer::Options opt;
+    opt.iterations = iterations;
+    opt.setup = [&]() -> void {
+        // Evicting the file from the page cache to mimic a cold start.
+        // This is only advisory, so a warm cache is still possible if the kernel ignores us.
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd >= 0) {
+            ::fdatasync(fd);
+            ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+            ::close(fd);
+        }
+        result.reset();
+    };
+
+    // Setting up the functions. Each one scores the query against all references,
+    // so that the mapped pages are actually touched.
+    std::vector<std::function<double()> > funs;
+    std::vector<std::string> names;
+
+    names.push_back("rebuild");
+    funs.emplace_back([&]() -> double {
+        ReferenceBlock block(len);
+        for (int p = 0; p < nprofiles; ++p) {
+            append_reference(block, negative_refs[p], positive_refs[p], buffer);
+        }
+        return score_all(len, block, dense_query);
+    });
+
+    names.push_back("mmap");
+    funs.emplace_back([&]() -> double {
+        MappedReferenceBlock block(path);
+        if (block.num_markers() != len) {
+            throw std::runtime_error("number of markers in '" + path + "' does not match the query length");
+        }
+        return score_all(len, block, dense_query);
+    });
+
+    // Performing the iterations.
+    auto res = eztimer::time<double>(
+        funs,
+        [&](const double& res, std::size_t i) -> void {
+            if (result.has_value()) {
+                if (std::abs(*result - res) / res > 1e-8) {
+                    std::cout << *result << "\t" << res << "\t" << names[i] << std::endl;
+                    throw std::runtime_error("oops that's not right");
+                }
+            } else {
+                result = res;
+            }
+        },
+        opt
+    );
+
+    for (std::size_t n = 0; n < names.size(); ++n) {
+        std::string nn = names[n];
+        nn.resize(32, ' ');
+        const double mu = res[n].mean.count(); 
+        const double se = res[n].sd.count() / std::sqrt(res[n].times.size());
+        std::cout << nn << ": " << mu << " ± " << (se / mu * 100) << " %" << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,145 @@
+#include "eztimer/eztimer.hpp"
+
+#include "CLI/App.hpp"
+#include "CLI/Formatter.hpp"
+#include "CLI/Config.hpp"
+
+#include "scaled_ranks.h"
+#include "simulate.h"
+#include "l2_kernels.h"
+#include "reference_file.h"
+#include "multi_query.h"
+
+#include <random>
+#include <vector>
+#include <optional>
+#include <iostream>
+#include <memory>
+#include <type_traits>
+
+int main(int argc, char ** argv) {
+    CLI::App app{"Multi-query interleaved L2 performance tests"};
+    int len;
+    app.add_option("-l,--length", len, "Length of the simulated vector")->default_val(1000);
+    double density;
+    app.add_option("-d,--density", density, "Density of non-zero elements in the simulated vector")->default_val(0.2);
+    int nrefs;
+    app.add_option("-n,--references", nrefs, "Number of references")->default_val(1000);
+    int nqueries;
+    app.add_option("-q,--queries", nqueries, "Number of queries, should be a multiple of 8")->default_val(64);
+    int iterations;
+    app.add_option("-i,--iter", iterations, "Number of iterations")->default_val(100);
+    unsigned long long seed;
+    app.add_option("-s,--seed", seed, "Seed for the simulated data")->default_val(69);
+    CLI11_PARSE(app, argc, argv);
+
+    if (nqueries % 8 != 0) {
+        throw std::runtime_error("number of queries should be a multiple of 8");
+    }
+
+    std::mt19937_64 rng(seed);
+
+    // Simulating the references.
+    RankedVector negative, positive;
+    std::vector<std::pair<int, double> > buffer;
+    buffer.reserve(len);
+    ReferenceBlock block(len);
+    for (int r = 0; r < nrefs; ++r) {
+        simulate_sparse(len, density, rng, negative, positive);
+        append_reference(block, negative, positive, buffer);
+    }
+
+    // Simulating the queries in the setup and packing them into blocks.
+    // Packing is not timed as it is done once per query and amortized across all references.
+    std::vector<std::vector<double> > dense_queries(nqueries, std::vector<double>(len));
+    std::vector<std::unique_ptr<QueryBlock<4> > > blocks4;
+    for (int q = 0; q < nqueries; q += 4) {
+        blocks4.emplace_back(new QueryBlock<4>(len));
+    }
+    std::vector<std::unique_ptr<QueryBlock<8> > > blocks8;
+    for (int q = 0; q < nqueries; q += 8) {
+        blocks8.emplace_back(new QueryBlock<8>(len));
+    }
+    std::optional<double> result;
+
+    eztimer::Options opt;
+    opt.iterations = iterations;
+    opt.setup = [&]() -> void {
+        for (int q = 0; q < nqueries; ++q) {
+            auto& dense_query = dense_queries[q];
+            double zero_query;
+            simulate_sparse(len, density, rng, negative, positive);
+            scaled_ranks(len, negative, positive, buffer, zero_query);
+            std::fill(dense_query.begin(), dense_query.end(), zero_query);
+            for (const auto& sq : buffer) {
+                dense_query[sq.first] = sq.second;
+            }
+            blocks4[q / 4]->set(q % 4, dense_query.data());
+            blocks8[q / 8]->set(q % 8, dense_query.data());
+        }
+        result.reset();
+    };
+
+    // Each function returns a weighted sum of the L2 distances for all query-reference pairs.
+    std::vector<std::function<double()> > funs;
+    std::vector<std::string> names;
+
+    names.push_back("single-query");
+    funs.emplace_back([&]() -> double {
+        double total = 0;
+        for (int r = 0; r < nrefs; ++r) {
+            for (int q = 0; q < nqueries; ++q) {
+                total += dense_sparse_unstable(len, dense_queries[q].data(), block.num_nonzero(r), block.profile_index(r), block.profile_value(r), block.profile_zero(r)) * (q + 1);
+            }
+        }
+        return total;
+    });
+
+    auto add_interleaved = [&](const std::string& name, const auto& blocks) -> void {
+        names.push_back(name);
+        funs.emplace_back([&]() -> double {
+            typedef typename std::decay<decltype(*(blocks.front()))>::type Block;
+            constexpr int width = Block::width;
+            double total = 0;
+            double output[width];
+            for (int r = 0; r < nrefs; ++r) {
+                for (std::size_t b = 0; b < blocks.size(); ++b) {
+                    multi_dense_sparse_unstable(*(blocks[b]), block.num_nonzero(r), block.profile_index(r), block.profile_value(r), block.profile_zero(r), output);
+                    for (int w = 0; w < width; ++w) {
+                        total += output[w] * (b * width + w + 1);
+                    }
+                }
+            }
+            return total;
+        });
+    };
+    add_interleaved("interleaved-4", blocks4);
+    add_interleaved("interleaved-8", blocks8);
+
+    auto res = eztimer::time<double>(
+        funs,
+        [&](const double& res, std::size_t i) -> void {
+            if (result.has_value()) {
+                if (std::abs(*result - res) > 1e-8 * std::abs(res)) {
+                    std::cout << *result << "\t" << res << "\t" << names[i] << std::endl;
+                    throw std::runtime_error("oops that's not right");
+                }
+            } else {
+                result = res;
+            }
+        },
+        opt
+    );
+
+    const double baseline = res[0].mean.count();
+    const double npairs = static_cast<double>(nrefs) * nqueries;
+    for (std::size_t n = 0; n < names.size(); ++n) {
+        std::string nn = names[n];
+        nn.resize(32, ' ');
+        const double mu = res[n].mean.count();
+        const double se = res[n].sd.count() / std::sqrt(res[n].times.size());
+        std::cout << nn << ": " << mu << " ± " << (se / mu * 100) << " %, " << (npairs / mu / 1e6) << " M pairs/s, speedup = " << baseline / mu << std::endl;
+    }
+
+    return 0;
+}
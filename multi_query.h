@@ -0,0 +1,165 @@
+#ifndef MULTI_QUERY_H
+#define MULTI_QUERY_H
+
+#include <vector>
+#include <cstddef>
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "aligned_buffer.h"
+
+// Dense queries interleaved in marker-major order, i.e., each marker's row contains the values of all queries.
+// A gather from a sparse reference then fetches the values for many queries with a single vector load,
+// rather than fetching one double from each of the separate query arrays.
+// The storage is an AlignedVector, and each row is padded to 'stride' doubles,
+// which should be a multiple of the SIMD width of the kernels below so that all of their loads are aligned.
+class QueryMatrix {
+public:
+    QueryMatrix(const int num_markers, const int num_queries, const int stride) :
+        my_num_markers(num_markers),
+        my_num_queries(num_queries),
+        my_stride(stride),
+        my_values(static_cast<std::size_t>(num_markers) * my_stride)
+    {}
+
+    // By default, the number of columns is padded to a multiple of 8, so that each row starts on a 64-byte boundary.
+    QueryMatrix(const int num_markers, const int num_queries) : QueryMatrix(num_markers, num_queries, (num_queries + alignment - 1) / alignment * alignment) {}
+
+public:
+    // Stores the dense query in column 'q'.
+    void set(const int q, const double* dense_query) {
+        for (int i = 0; i < my_num_markers; ++i) {
+            my_values[static_cast<std::size_t>(i) * my_stride + q] = dense_query[i];
+        }
+    }
+
+    const double* values() const {
+        return my_values.data();
+    }
+
+    const double* row(const int marker) const {
+        return my_values.data() + static_cast<std::size_t>(marker) * my_stride;
+    }
+
+    int num_markers() const {
+        return my_num_markers;
+    }
+
+    int num_queries() const {
+        return my_num_queries;
+    }
+
+    int stride() const {
+        return my_stride;
+    }
+
+private:
+    static constexpr int alignment = simd_alignment / sizeof(double);
+    int my_num_markers, my_num_queries, my_stride;
+    AlignedVector<double> my_values;
+};
+
+// Block of exactly 'Width_' dense queries with no padding between rows.
+// With a width of 8, each marker occupies exactly one cache line.
+template<int Width_>
+class QueryBlock : public QueryMatrix {
+public:
+    QueryBlock(const int num_markers) : QueryMatrix(num_markers, Width_, Width_) {}
+
+    static constexpr int width = Width_;
+};
+
+// Computes the sparse part of dense_sparse_unstable(), i.e., the dot product of the reference's centered non-zero values with '(ref - 2 * query)',
+// for 'Width_' consecutive queries starting at 'queries', where consecutive markers are 'stride' doubles apart.
+// The results are stored in 'output'. The accumulators for all queries are kept in registers for the entire pass through the non-zero entries.
+template<int Width_>
+void multi_sparse_dot(
+    const double* queries,
+    const std::size_t stride,
+    const int num_nonzero,
+    const int* sparse_ref_index,
+    const double* sparse_ref_value,
+    const double zero_ref,
+    double* output
+) {
+#if defined(__AVX512F__)
+    if constexpr (Width_ % 8 == 0) {
+        constexpr int num_registers = Width_ / 8;
+        const __m512d two = _mm512_set1_pd(2);
+        __m512d l2[num_registers];
+        for (int v = 0; v < num_registers; ++v) {
+            l2[v] = _mm512_setzero_pd();
+        }
+        for (int i = 0; i < num_nonzero; ++i) {
+            const double* current = queries + static_cast<std::size_t>(sparse_ref_index[i]) * stride;
+            const __m512d ref = _mm512_set1_pd(sparse_ref_value[i] - zero_ref);
+            for (int v = 0; v < num_registers; ++v) {
+                const __m512d target = _mm512_load_pd(current + 8 * v);
+                l2[v] = _mm512_fmadd_pd(ref, _mm512_fnmadd_pd(two, target, ref), l2[v]);
+            }
+        }
+        for (int v = 0; v < num_registers; ++v) {
+            _mm512_storeu_pd(output + 8 * v, l2[v]);
+        }
+        return;
+    }
+#endif
+
+#if defined(__AVX2__) && defined(__FMA__)
+    if constexpr (Width_ % 4 == 0) {
+        constexpr int num_registers = Width_ / 4;
+        const __m256d two = _mm256_set1_pd(2);
+        __m256d l2[num_registers];
+        for (int v = 0; v < num_registers; ++v) {
+            l2[v] = _mm256_setzero_pd();
+        }
+        for (int i = 0; i < num_nonzero; ++i) {
+            const double* current = queries + static_cast<std::size_t>(sparse_ref_index[i]) * stride;
+            const __m256d ref = _mm256_set1_pd(sparse_ref_value[i] - zero_ref);
+            for (int v = 0; v < num_registers; ++v) {
+                const __m256d target = _mm256_load_pd(current + 4 * v);
+                l2[v] = _mm256_fmadd_pd(ref, _mm256_fnmadd_pd(two, target, ref), l2[v]);
+            }
+        }
+        for (int v = 0; v < num_registers; ++v) {
+            _mm256_storeu_pd(output + 4 * v, l2[v]);
+        }
+        return;
+    }
+#endif
+
+    double l2[Width_] = {};
+    for (int i = 0; i < num_nonzero; ++i) {
+        const double* current = queries + static_cast<std::size_t>(sparse_ref_index[i]) * stride;
+        const double ref = sparse_ref_value[i] - zero_ref;
+        for (int q = 0; q < Width_; ++q) {
+            l2[q] += ref * (ref - 2 * current[q]);
+        }
+    }
+    for (int q = 0; q < Width_; ++q) {
+        output[q] = l2[q];
+    }
+}
+
+// Same as dense_sparse_unstable() for each query in the block, storing the L2 distances in 'output'.
+template<int Width_>
+void multi_dense_sparse_unstable(
+    const QueryBlock<Width_>& block,
+    const int num_nonzero,
+    const int* sparse_ref_index,
+    const double* sparse_ref_value,
+    const double zero_ref,
+    double* output
+) {
+    multi_sparse_dot<Width_>(block.values(), Width_, num_nonzero, sparse_ref_index, sparse_ref_value, zero_ref, output);
+
+    const double x2 = (num_nonzero == 0 ? 0 : 0.25);
+    const double constant = x2 - block.num_markers() * zero_ref * zero_ref;
+    for (int q = 0; q < Width_; ++q) {
+        output[q] += constant;
+    }
+}
+
+#endif
@@ -0,0 +1,139 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstring>
+#endif
+
+// Hardware event counters for the calling thread via Linux's perf_event_open().
+// These are often unavailable, e.g., in containers or VMs without a virtualized PMU, or if kernel.perf_event_paranoid is too high;
+// in such cases, available() returns false and all counts are reported as zero, so callers should just skip the report.
+enum class PerfEvent {
+    CACHE_MISSES,
+    L1D_READ_MISSES,
+    DTLB_READS,
+    DTLB_READ_MISSES
+};
+
+inline std::string perf_event_name(const PerfEvent event) {
+    switch (event) {
+        case PerfEvent::CACHE_MISSES:
+            return "cache-misses";
+        case PerfEvent::L1D_READ_MISSES:
+            return "L1d-read-misses";
+        case PerfEvent::DTLB_READS:
+            return "dTLB-reads";
+        case PerfEvent::DTLB_READ_MISSES:
+            return "dTLB-read-misses";
+    }
+    return "unknown";
+}
+
+class PerfCounters {
+public:
+    PerfCounters(std::vector<PerfEvent> events) : my_events(std::move(events)), my_fds(my_events.size(), -1) {
+#if defined(__linux__)
+        for (std::size_t e = 0; e < my_events.size(); ++e) {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+
+            switch (my_events[e]) {
+                case PerfEvent::CACHE_MISSES:
+                    attr.type = PERF_TYPE_HARDWARE;
+                    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+                    break;
+                case PerfEvent::L1D_READ_MISSES:
+                    attr.type = PERF_TYPE_HW_CACHE;
+                    attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+                    break;
+                case PerfEvent::DTLB_READS:
+                    attr.type = PERF_TYPE_HW_CACHE;
+                    attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_ACCESS << 16);
+                    break;
+                case PerfEvent::DTLB_READ_MISSES:
+                    attr.type = PERF_TYPE_HW_CACHE;
+                    attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+                    break;
+            }
+
+            my_fds[e] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        }
+#endif
+    }
+
+    ~PerfCounters() {
+#if defined(__linux__)
+        for (auto fd : my_fds) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+#endif
+    }
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+public:
+    // Whether all of the requested events could be opened.
+    bool available() const {
+        for (auto fd : my_fds) {
+            if (fd < 0) {
+                return false;
+            }
+        }
+        return !my_fds.empty();
+    }
+
+    const std::vector<PerfEvent>& events() const {
+        return my_events;
+    }
+
+    // Resets all counters to zero and starts counting.
+    void start() {
+#if defined(__linux__)
+        for (auto fd : my_fds) {
+            if (fd >= 0) {
+                ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+#endif
+    }
+
+    // Stops counting and returns the count for each event since the last start().
+    std::vector<std::uint64_t> stop() {
+        std::vector<std::uint64_t> output(my_fds.size());
+#if defined(__linux__)
+        for (std::size_t e = 0; e < my_fds.size(); ++e) {
+            const auto fd = my_fds[e];
+            if (fd >= 0) {
+                ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+                std::uint64_t count = 0;
+                if (read(fd, &count, sizeof(count)) == sizeof(count)) {
+                    output[e] = count;
+                }
+            }
+        }
+#endif
+        return output;
+    }
+
+private:
+    std::vector<PerfEvent> my_events;
+    std::vector<long> my_fds;
+};
+
+#endif
@@ -0,0 +1,175 @@
+#include "CLI/App.hpp"
+#include "CLI/Formatter.hpp"
+#include "CLI/Config.hpp"
+
+#include "scaled_ranks.h"
+#include "simulate.h"
+#include "reference_file.h"
+#include "query_context.h"
+#include "quantile_scorer.h"
+#include "pipeline.h"
+
+#include <random>
+#include <vector>
+#include <iostream>
+#include <chrono>
+#include <stdexcept>
+
+struct Cell {
+    Cell(const int num_markers) : context(num_markers) {
+        raw.reserve(num_markers);
+        negative.reserve(num_markers);
+        positive.reserve(num_markers);
+    }
+
+    std::vector<std::pair<int, double> > raw;
+    RankedVector negative, positive;
+    QueryContext context;
+    int best_label = -1;
+    double best_score = 0;
+};
+
+int main(int argc, char ** argv) {
+    CLI::App app{"Streaming pipeline throughput tests"};
+    int len;
+    app.add_option("-l,--length", len, "Length of the simulated vector")->default_val(1000);
+    double density;
+    app.add_option("-d,--density", density, "Density of non-zero elements in the simulated vector")->default_val(0.2);
+    int nlabels;
+    app.add_option("-L,--labels", nlabels, "Number of labels")->default_val(10);
+    int nperlabel;
+    app.add_option("-n,--references", nperlabel, "Number of references per label")->default_val(100);
+    double quantile;
+    app.add_option("-q,--quantile", quantile, "Quantile of the correlations to use as the score")->default_val(0.8);
+    std::size_t ncells;
+    app.add_option("-c,--cells", ncells, "Number of simulated query cells")->default_val(10000);
+    PipelineOptions popt;
+    app.add_option("--ingest-threads", popt.ingest_threads, "Number of threads for ingesting cells")->default_val(1);
+    app.add_option("--rank-threads", popt.rank_threads, "Number of threads for computing scaled ranks")->default_val(1);
+    app.add_option("--score-threads", popt.score_threads, "Number of threads for scoring against the references")->default_val(2);
+    app.add_option("--capacity", popt.queue_capacity, "Capacity of the queues between stages")->default_val(64);
+    unsigned long long seed;
+    app.add_option("-s,--seed", seed, "Seed for the simulated data")->default_val(69);
+    CLI11_PARSE(app, argc, argv);
+
+    // Each stage needs at least one thread, otherwise the upstream stages block forever on a full queue.
+    if (popt.ingest_threads < 1 || popt.rank_threads < 1 || popt.score_threads < 1) {
+        throw std::runtime_error("each stage should have at least one thread");
+    }
+    if (popt.queue_capacity < 1) {
+        throw std::runtime_error("queue capacity should be positive");
+    }
+
+    if (!(quantile >= 0 && quantile <= 1)) {
+        throw std::runtime_error("quantile should lie in [0, 1]");
+    }
+
+    // Setting up the references, where each label's references are stored contiguously.
+    std::mt19937_64 rng(seed);
+    RankedVector negative, positive;
+    std::vector<std::pair<int, double> > buffer;
+    buffer.reserve(len);
+    ReferenceBlock block(len);
+    for (int r = 0, nrefs = nlabels * nperlabel; r < nrefs; ++r) {
+        simulate_sparse(len, density, rng, negative, positive);
+        append_reference(block, negative, positive, buffer);
+    }
+
+    // Defining the stages. Each cell is simulated from its own seed so that the results do not depend on the thread scheduling.
+    auto ingest = [&](Cell& cell, std::size_t id, int) -> void {
+        std::mt19937_64 cell_rng(seed + id + 1);
+        std::normal_distribution<> normdist;
+        std::uniform_real_distribution<> unifdist;
+        cell.raw.clear();
+        for (int i = 0; i < len; ++i) {
+            if (unifdist(cell_rng) <= density) {
+                cell.raw.emplace_back(i, normdist(cell_rng));
+            }
+        }
+    };
+
+    auto rank = [&](Cell& cell, int) -> void {
+        cell.negative.clear();
+        cell.positive.clear();
+        for (const auto& r : cell.raw) {
+            if (r.second < 0) {
+                cell.negative.emplace_back(r.second, r.first);
+            } else if (r.second > 0) {
+                cell.positive.emplace_back(r.second, r.first);
+            }
+        }
+        std::sort(cell.negative.begin(), cell.negative.end());
+        std::sort(cell.positive.begin(), cell.positive.end());
+        cell.context.reset(cell.negative, cell.positive);
+        cell.context.dense();
+    };
+
+    std::vector<QuantileScorer> scorers(popt.score_threads, QuantileScorer(quantile));
+    auto score = [&](Cell& cell, int thread) -> void {
+        auto& scorer = scorers[thread];
+        cell.best_label = -1;
+        for (int l = 0; l < nlabels; ++l) {
+            scorer.reset(nperlabel);
+            const std::size_t offset = static_cast<std::size_t>(l) * nperlabel;
+            for (int r = 0; r < nperlabel; ++r) {
+                const std::size_t p = offset + r;
+                scorer.add_l2(dense_sparse_unstable(cell.context, block.num_nonzero(p), block.profile_index(p), block.profile_value(p), block.profile_zero(p)));
+            }
+            const double current = scorer.score();
+            if (cell.best_label < 0 || current > cell.best_score) {
+                cell.best_label = l;
+                cell.best_score = current;
+            }
+        }
+    };
+
+    double checksum = 0;
+    std::vector<std::size_t> assigned(nlabels);
+    auto emit = [&](Cell& cell) -> void {
+        checksum += cell.best_score;
+        ++assigned[cell.best_label];
+    };
+
+    // Running all stages serially on a single cell as a baseline.
+    {
+        Cell cell(len);
+        const auto start = std::chrono::steady_clock::now();
+        for (std::size_t c = 0; c < ncells; ++c) {
+            ingest(cell, c, 0);
+            rank(cell, 0);
+            score(cell, 0);
+            emit(cell);
+        }
+        const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "serial                          : " << ncells / elapsed << " cells/s" << std::endl;
+    }
+
+    const double serial_checksum = checksum;
+    checksum = 0;
+    std::fill(assigned.begin(), assigned.end(), 0);
+
+    std::vector<Cell> pool;
+    const std::size_t npool = 3 * popt.queue_capacity + popt.ingest_threads + popt.rank_threads + popt.score_threads + 1;
+    pool.reserve(npool);
+    for (std::size_t p = 0; p < npool; ++p) {
+        pool.emplace_back(len);
+    }
+
+    popt.num_items = ncells;
+    auto stats = run_pipeline(pool, ingest, rank, score, emit, popt);
+
+    if (std::abs(checksum - serial_checksum) > 1e-8 * std::abs(serial_checksum)) {
+        std::cout << serial_checksum << "\t" << checksum << std::endl;
+        throw std::runtime_error("oops that's not right");
+    }
+
+    std::cout << "pipeline                        : " << ncells / stats.seconds << " cells/s" << std::endl;
+    const char* queue_names[3] = { "ingest -> rank", "rank -> score", "score -> emit" };
+    for (int q = 0; q < 3; ++q) {
+        std::string nn = queue_names[q];
+        nn.resize(32, ' ');
+        std::cout << nn << ": " << stats.occupancy[q] << " / " << stats.capacity << " items" << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,168 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+
+#include "ring_buffer.h"
+
+// Streaming driver for the ingest -> rank -> score -> emit stages of query classification.
+// Each stage runs in its own set of threads and passes pointers to work items through bounded queues.
+// The work items are preallocated by the caller and recycled from the emit stage back to the ingest stage,
+// so the pipeline does not allocate in the steady state as long as the stages themselves don't.
+struct PipelineOptions {
+    std::size_t num_items = 1000;
+    int ingest_threads = 1;
+    int rank_threads = 1;
+    int score_threads = 1;
+    std::size_t queue_capacity = 64;
+
+    // Interval between samples of the queue occupancy.
+    std::chrono::microseconds monitor_interval = std::chrono::microseconds(100);
+};
+
+struct PipelineStats {
+    double seconds = 0;
+
+    // Mean number of items in the queues leading into the rank, score and emit stages, respectively.
+    double occupancy[3] = { 0, 0, 0 };
+    std::size_t capacity = 0;
+};
+
+// Stage functions are called as:
+//
+// - ingest(item, id, thread) to fill 'item' with the input for item 'id', where 'thread' is the index of the ingest thread.
+// - rank(item, thread) to compute the scaled ranks for 'item'.
+// - score(item, thread) to score the ranked 'item' against the references.
+// - emit(item) to report the results for 'item'. This is always called from a single thread.
+//
+// 'pool' should contain enough items to keep all stages busy, e.g., at least 3 * queue_capacity plus the number of threads.
+template<class Item_, class Ingest_, class Rank_, class Score_, class Emit_>
+PipelineStats run_pipeline(std::vector<Item_>& pool, Ingest_ ingest, Rank_ rank, Score_ score, Emit_ emit, const PipelineOptions& options) {
+    if (pool.empty()) {
+        throw std::runtime_error("pipeline needs at least one work item");
+    }
+    if (options.ingest_threads < 1 || options.rank_threads < 1 || options.score_threads < 1) {
+        throw std::runtime_error("pipeline needs at least one thread for each stage");
+    }
+
+    const int total_threads = options.ingest_threads + options.rank_threads + options.score_threads + 1;
+    MpmcQueue<Item_*> free_items(pool.size());
+    for (auto& p : pool) {
+        free_items.try_push(&p);
+    }
+
+    Channel<Item_*> to_rank(options.queue_capacity, options.ingest_threads, options.rank_threads);
+    Channel<Item_*> to_score(options.queue_capacity, options.rank_threads, options.score_threads);
+    Channel<Item_*> to_emit(options.queue_capacity, options.score_threads, 1);
+
+    // Number of threads in each stage that are still running, so that downstream stages know when to stop.
+    std::atomic<int> ingest_running(options.ingest_threads);
+    std::atomic<int> rank_running(options.rank_threads);
+    std::atomic<int> score_running(options.score_threads);
+    std::atomic<std::size_t> next_id(0);
+    std::atomic<bool> finished(false);
+
+    auto push = [](auto& channel, Item_* item) -> void {
+        while (!channel.try_push(item)) {
+            std::this_thread::yield();
+        }
+    };
+
+    // Generic loop for a consumer stage, which stops once the upstream stage is finished and the queue is empty.
+    auto consume = [](auto& channel, std::atomic<int>& upstream_running, auto process) -> void {
+        Item_* item;
+        while (1) {
+            if (channel.try_pop(item)) {
+                process(item);
+            } else if (upstream_running.load(std::memory_order_acquire) == 0) {
+                // Trying again as the last items might have been pushed just before the upstream stage finished.
+                if (!channel.try_pop(item)) {
+                    break;
+                }
+                process(item);
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(total_threads);
+    const auto start = std::chrono::steady_clock::now();
+
+    for (int t = 0; t < options.ingest_threads; ++t) {
+        threads.emplace_back([&,t]() -> void {
+            while (1) {
+                const std::size_t id = next_id.fetch_add(1, std::memory_order_relaxed);
+                if (id >= options.num_items) {
+                    break;
+                }
+                Item_* item;
+                while (!free_items.try_pop(item)) {
+                    std::this_thread::yield();
+                }
+                ingest(*item, id, t);
+                push(to_rank, item);
+            }
+            ingest_running.fetch_sub(1, std::memory_order_release);
+        });
+    }
+
+    for (int t = 0; t < options.rank_threads; ++t) {
+        threads.emplace_back([&,t]() -> void {
+            consume(to_rank, ingest_running, [&](Item_* item) -> void {
+                rank(*item, t);
+                push(to_score, item);
+            });
+            rank_running.fetch_sub(1, std::memory_order_release);
+        });
+    }
+
+    for (int t = 0; t < options.score_threads; ++t) {
+        threads.emplace_back([&,t]() -> void {
+            consume(to_score, rank_running, [&](Item_* item) -> void {
+                score(*item, t);
+                push(to_emit, item);
+            });
+            score_running.fetch_sub(1, std::memory_order_release);
+        });
+    }
+
+    threads.emplace_back([&]() -> void {
+        consume(to_emit, score_running, [&](Item_* item) -> void {
+            emit(*item);
+            push(free_items, item);
+        });
+        finished.store(true, std::memory_order_release);
+    });
+
+    // Sampling the queue occupancy from the main thread until all stages are finished.
+    PipelineStats stats;
+    stats.capacity = to_rank.capacity();
+    std::size_t samples = 0;
+    while (!finished.load(std::memory_order_acquire)) {
+        stats.occupancy[0] += to_rank.size();
+        stats.occupancy[1] += to_score.size();
+        stats.occupancy[2] += to_emit.size();
+        ++samples;
+        std::this_thread::sleep_for(options.monitor_interval);
+    }
+
+    for (auto& t : threads) {
+        t.join();
+    }
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (samples) {
+        for (auto& o : stats.occupancy) {
+            o /= samples;
+        }
+    }
+    return stats;
+}
+
+#endif
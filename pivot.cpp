@@ -0,0 +1,180 @@
+#include "eztimer/eztimer.hpp"
+
+#include "CLI/App.hpp"
+#include "CLI/Formatter.hpp"
+#include "CLI/Config.hpp"
+
+#include "scaled_ranks.h"
+#include "simulate.h"
+#include "l2_kernels.h"
+#include "reference_file.h"
+#include "pivot_index.h"
+
+#include <random>
+#include <vector>
+#include <optional>
+#include <iostream>
+#include <chrono>
+#include <numeric>
+
+int main(int argc, char ** argv) {
+    CLI::App app{"Pivot-based pruning performance tests"};
+    int len;
+    app.add_option("-l,--length", len, "Length of the simulated vector")->default_val(1000);
+    double density;
+    app.add_option("-d,--density", density, "Density of non-zero elements in the simulated vector")->default_val(0.2);
+    int nrefs;
+    app.add_option("-n,--references", nrefs, "Number of reference profiles")->default_val(10000);
+    int nclusters;
+    app.add_option("-c,--clusters", nclusters, "Number of clusters in the reference profiles")->default_val(20);
+    double noise;
+    app.add_option("--noise", noise, "Standard deviation of the noise around each cluster center")->default_val(0.5);
+    int npivots;
+    app.add_option("-p,--pivots", npivots, "Number of pivots")->default_val(16);
+    int k;
+    app.add_option("-k,--neighbors", k, "Number of nearest references to find")->default_val(10);
+    double threshold;
+    app.add_option("-r,--radius", threshold, "L2 threshold for the radius search, e.g., 0.1 for correlations above 0.8")->default_val(0.1);
+    int iterations;
+    app.add_option("-i,--iter", iterations, "Number of iterations")->default_val(100);
+    unsigned long long seed;
+    app.add_option("-s,--seed", seed, "Seed for the simulated data")->default_val(69);
+    CLI11_PARSE(app, argc, argv);
+
+    // We can't find more neighbors than there are references.
+    k = std::max(0, std::min(k, nrefs));
+
+    std::mt19937_64 rng(seed);
+
+    // Simulating the cluster centers and the references around them.
+    RankedVector negative, positive;
+    std::vector<std::vector<double> > centers(nclusters);
+    for (auto& center : centers) {
+        center.resize(len);
+        simulate_sparse(len, density, rng, negative, positive);
+        for (const auto& n : negative) {
+            center[n.second] = n.first;
+        }
+        for (const auto& p : positive) {
+            center[p.second] = p.first;
+        }
+    }
+
+    std::vector<std::pair<int, double> > buffer;
+    buffer.reserve(len);
+    ReferenceBlock block(len);
+    std::uniform_int_distribution<> clustdist(0, nclusters - 1);
+    for (int r = 0; r < nrefs; ++r) {
+        simulate_from_center(centers[clustdist(rng)], noise, rng, negative, positive);
+        append_reference(block, negative, positive, buffer);
+    }
+
+    const auto build_start = std::chrono::steady_clock::now();
+    PivotIndex<ReferenceBlock> index(block, len, npivots);
+    const auto build_end = std::chrono::steady_clock::now();
+    std::cout << "Built index with " << index.num_pivots() << " pivots in " << std::chrono::duration<double>(build_end - build_start).count() << " s" << std::endl;
+
+    // Setting up the queries, which are drawn from the same clusters.
+    std::vector<std::pair<int, double> > sparse_query;
+    sparse_query.reserve(len);
+    double zero_query;
+    std::vector<double> dense_query(len);
+
+    std::vector<std::optional<double> > results(2);
+    eztimer::Options opt;
+    opt.iterations = iterations;
+    opt.setup = [&]() -> void {
+        simulate_from_center(centers[clustdist(rng)], noise, rng, negative, positive);
+        scaled_ranks(len, negative, positive, sparse_query, zero_query);
+        std::fill(dense_query.begin(), dense_query.end(), zero_query);
+        for (const auto& sq : sparse_query) {
+            dense_query[sq.first] = sq.second;
+        }
+        for (auto& r : results) {
+            r.reset();
+        }
+    };
+
+    auto exact_l2 = [&](std::size_t r) -> double {
+        return dense_sparse_unstable(len, dense_query.data(), block.num_nonzero(r), block.profile_index(r), block.profile_value(r), block.profile_zero(r));
+    };
+
+    // Setting up the functions. Each task has an exhaustive and a pruned version that must give the same result.
+    std::vector<std::function<double()> > funs;
+    std::vector<std::string> names;
+    std::vector<int> tasks;
+    std::vector<double> computed;
+
+    names.push_back("exhaustive-nearest");
+    tasks.push_back(0);
+    std::vector<double> all_l2(nrefs);
+    funs.emplace_back([&]() -> double {
+        for (int r = 0; r < nrefs; ++r) {
+            all_l2[r] = exact_l2(r);
+        }
+        std::partial_sort(all_l2.begin(), all_l2.begin() + k, all_l2.end());
+        computed[0] += nrefs;
+        return std::accumulate(all_l2.begin(), all_l2.begin() + k, 0.0);
+    });
+
+    names.push_back("pivot-nearest");
+    tasks.push_back(0);
+    funs.emplace_back([&]() -> double {
+        auto found = index.nearest(dense_query.data(), k);
+        computed[1] += index.num_computed();
+        double total = 0;
+        for (const auto& f : found) {
+            total += f.first;
+        }
+        return total;
+    });
+
+    names.push_back("exhaustive-radius");
+    tasks.push_back(1);
+    funs.emplace_back([&]() -> double {
+        int found = 0;
+        for (int r = 0; r < nrefs; ++r) {
+            found += exact_l2(r) <= threshold;
+        }
+        computed[2] += nrefs;
+        return found;
+    });
+
+    names.push_back("pivot-radius");
+    tasks.push_back(1);
+    funs.emplace_back([&]() -> double {
+        auto found = index.within(dense_query.data(), threshold);
+        computed[3] += index.num_computed();
+        return found.size();
+    });
+
+    computed.resize(funs.size());
+
+    // Performing the iterations.
+    auto res = eztimer::time<double>(
+        funs,
+        [&](const double& res, std::size_t i) -> void {
+            auto& result = results[tasks[i]];
+            if (result.has_value()) {
+                if (std::abs(*result - res) > 1e-8 * std::abs(res)) {
+                    std::cout << *result << "\t" << res << "\t" << names[i] << std::endl;
+                    throw std::runtime_error("oops that's not right");
+                }
+            } else {
+                result = res;
+            }
+        },
+        opt
+    );
+
+    for (std::size_t n = 0; n < names.size(); ++n) {
+        std::string nn = names[n];
+        nn.resize(32, ' ');
+        const double mu = res[n].mean.count(); 
+        const double se = res[n].sd.count() / std::sqrt(res[n].times.size());
+        const double avoided = 1 - computed[n] / res[n].times.size() / nrefs;
+        std::cout << nn << ": " << mu << " ± " << (se / mu * 100) << " %, " << (avoided * 100) << "% of L2 calculations avoided" << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,215 @@
+#ifndef PIVOT_INDEX_H
+#define PIVOT_INDEX_H
+
+#include <algorithm>
+#include <vector>
+#include <utility>
+#include <queue>
+#include <cmath>
+#include <limits>
+
+#include "l2_kernels.h"
+
+// Pivot table for pruning L2 calculations between a query and a set of sparse references, e.g., a ReferenceBlock or MappedReferenceBlock.
+// The L2 "norm" computed by the kernels is the squared Euclidean distance between scaled rank vectors,
+// so its square root is a true metric and the triangle inequality gives us |d(q, p) - d(r, p)| <= d(q, r) for any pivot p.
+// We precompute the distances from each reference to a handful of pivots, so that each query only needs its distances to the pivots
+// to obtain a lower bound on its distance to every reference; references whose lower bounds exceed the current cut-off can then be skipped.
+template<class Block_>
+class PivotIndex {
+public:
+    PivotIndex(const Block_& block, const int num_markers, const int num_pivots) :
+        my_block(block),
+        my_num_markers(num_markers),
+        my_num_refs(block.num_profiles()),
+        my_pivot_slot(my_num_refs, -1),
+        my_buffer(num_markers)
+    {
+        // Choosing pivots by farthest-first traversal, so that they are spread across the reference set.
+        // Chosen pivots are excluded from further selection by setting their 'closest' to -infinity.
+        // We stop early if all remaining references are at (numerically) zero distance from an existing pivot, e.g., duplicates,
+        // as further pivots would not tighten any bounds.
+        const std::size_t max_pivots = std::min<std::size_t>(std::max(num_pivots, 0), my_num_refs);
+        std::vector<double> closest(my_num_refs, std::numeric_limits<double>::infinity());
+        std::vector<double> pivot_distances; // pivot-major, as we don't know the final number of pivots yet.
+        pivot_distances.reserve(max_pivots * my_num_refs);
+
+        std::size_t next = 0;
+        while (my_pivots.size() < max_pivots) {
+            my_pivot_slot[next] = my_pivots.size();
+            my_pivots.push_back(next);
+            closest[next] = -std::numeric_limits<double>::infinity();
+
+            densify(next);
+            for (std::size_t r = 0; r < my_num_refs; ++r) {
+                const double d = distance(my_buffer.data(), r);
+                pivot_distances.push_back(d);
+                closest[r] = std::min(closest[r], d);
+            }
+
+            next = std::max_element(closest.begin(), closest.end()) - closest.begin();
+            if (!(closest[next] > distance_tolerance())) {
+                break;
+            }
+        }
+
+        my_num_pivots = my_pivots.size();
+        my_distances.resize(my_num_refs * my_num_pivots);
+        for (std::size_t p = 0; p < my_num_pivots; ++p) {
+            for (std::size_t r = 0; r < my_num_refs; ++r) {
+                my_distances[r * my_num_pivots + p] = pivot_distances[p * my_num_refs + r];
+            }
+        }
+    }
+
+private:
+    const Block_& my_block;
+    int my_num_markers;
+    std::size_t my_num_refs, my_num_pivots;
+    std::vector<std::size_t> my_pivots;
+    std::vector<double> my_distances;
+    std::vector<int> my_pivot_slot; // position of each reference in my_pivots, or -1 if it is not a pivot.
+
+    std::vector<double> my_buffer;
+    std::vector<double> my_query_l2;
+    std::vector<double> my_query_distances;
+    std::vector<double> my_bounds;
+    std::size_t my_num_computed = 0;
+
+    // Allowance for the numerical imprecision of dense-sparse-unstable, so that we never prune a reference that should be reported.
+    // The absolute error in each L2 is small, but the square root amplifies it near zero as sqrt(x + e) - sqrt(x) <= sqrt(e).
+    // So, the slack on the distances is the square root of the L2 tolerance, for each of the three distances in the triangle inequality.
+    static constexpr double l2_tolerance = 1e-12;
+
+    static double distance_tolerance() {
+        return 3 * std::sqrt(l2_tolerance);
+    }
+
+    void densify(const std::size_t r) {
+        std::fill(my_buffer.begin(), my_buffer.end(), my_block.profile_zero(r));
+        const int num = my_block.num_nonzero(r);
+        const int* index = my_block.profile_index(r);
+        const double* value = my_block.profile_value(r);
+        for (int i = 0; i < num; ++i) {
+            my_buffer[index[i]] = value[i];
+        }
+    }
+
+    double l2(const double* dense_query, const std::size_t r) const {
+        return dense_sparse_unstable(my_num_markers, dense_query, my_block.num_nonzero(r), my_block.profile_index(r), my_block.profile_value(r), my_block.profile_zero(r));
+    }
+
+    static double to_distance(const double l2) {
+        return std::sqrt(std::max(l2, 0.0));
+    }
+
+    double distance(const double* dense_query, const std::size_t r) const {
+        return to_distance(l2(dense_query, r));
+    }
+
+    void compute_bounds(const double* dense_query) {
+        my_query_l2.resize(my_num_pivots);
+        my_query_distances.resize(my_num_pivots);
+        for (std::size_t p = 0; p < my_num_pivots; ++p) {
+            my_query_l2[p] = l2(dense_query, my_pivots[p]);
+            my_query_distances[p] = to_distance(my_query_l2[p]);
+        }
+        my_num_computed = my_num_pivots;
+
+        my_bounds.resize(my_num_refs);
+        for (std::size_t r = 0; r < my_num_refs; ++r) {
+            const double* ref_distances = my_distances.data() + r * my_num_pivots;
+            double bound = 0;
+            for (std::size_t p = 0; p < my_num_pivots; ++p) {
+                bound = std::max(bound, std::abs(my_query_distances[p] - ref_distances[p]));
+            }
+            my_bounds[r] = bound;
+        }
+    }
+
+public:
+    // Returns the L2 norms and indices of the 'k' nearest references, sorted by increasing L2.
+    std::vector<std::pair<double, std::size_t> > nearest(const double* dense_query, const std::size_t k) {
+        if (k == 0) {
+            my_num_computed = 0;
+            return std::vector<std::pair<double, std::size_t> >();
+        }
+        compute_bounds(dense_query);
+
+        // Max-heap of the closest references so far, seeded with the pivots as we already know their distances.
+        // This gives us a reasonable cut-off from the start, so we can just scan the references in order rather than sorting by the bounds.
+        std::priority_queue<std::pair<double, std::size_t> > closest;
+        double cutoff = std::numeric_limits<double>::infinity();
+        auto add = [&](const double current, const std::size_t r) -> void {
+            if (closest.size() < k) {
+                closest.emplace(current, r);
+            } else if (current < closest.top().first) {
+                closest.pop();
+                closest.emplace(current, r);
+            }
+            if (closest.size() == k) {
+                cutoff = to_distance(closest.top().first);
+            }
+        };
+
+        for (std::size_t p = 0; p < my_num_pivots; ++p) {
+            add(my_query_l2[p], my_pivots[p]);
+        }
+
+        const double slack = distance_tolerance();
+        for (std::size_t r = 0; r < my_num_refs; ++r) {
+            // Pivots were already added to the heap above, so they must be skipped to avoid adding them twice.
+            if (my_bounds[r] > cutoff + slack || my_pivot_slot[r] >= 0) {
+                continue;
+            }
+            add(l2(dense_query, r), r);
+            ++my_num_computed;
+        }
+
+        std::vector<std::pair<double, std::size_t> > output;
+        output.reserve(closest.size());
+        while (!closest.empty()) {
+            output.push_back(closest.top());
+            closest.pop();
+        }
+        std::reverse(output.begin(), output.end());
+        return output;
+    }
+
+    // Returns the L2 norms and indices of all references with L2 norms no greater than 'threshold', in order of increasing index.
+    std::vector<std::pair<double, std::size_t> > within(const double* dense_query, const double threshold) {
+        compute_bounds(dense_query);
+        const double radius = to_distance(threshold) + distance_tolerance();
+
+        std::vector<std::pair<double, std::size_t> > output;
+        for (std::size_t r = 0; r < my_num_refs; ++r) {
+            double current;
+            const int slot = my_pivot_slot[r];
+            if (slot >= 0) {
+                // Re-using the L2 norms to the pivots, which were already computed (and counted) for the bounds.
+                current = my_query_l2[slot];
+            } else {
+                if (my_bounds[r] > radius) {
+                    continue;
+                }
+                current = l2(dense_query, r);
+                ++my_num_computed;
+            }
+            if (current <= threshold) {
+                output.emplace_back(current, r);
+            }
+        }
+        return output;
+    }
+
+    // Number of L2 calculations in the last call to nearest() or within(), including those for the pivots.
+    std::size_t num_computed() const {
+        return my_num_computed;
+    }
+
+    std::size_t num_pivots() const {
+        return my_num_pivots;
+    }
+};
+
+#endif
@@ -0,0 +1,183 @@
+#include "eztimer/eztimer.hpp"
+
+#include "CLI/App.hpp"
+#include "CLI/Formatter.hpp"
+#include "CLI/Config.hpp"
+
+#include "scaled_ranks.h"
+#include "simulate.h"
+#include "l2_kernels.h"
+#include "reference_file.h"
+#include "prefetch.h"
+
+#include <random>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+
+int main(int argc, char ** argv) {
+    CLI::App app{"Software prefetching performance tests"};
+    int len;
+    app.add_option("-l,--length", len, "Length of the simulated vector")->default_val(100000);
+    double density;
+    app.add_option("-d,--density", density, "Density of non-zero elements in the simulated vector")->default_val(0.2);
+    int nrefs;
+    app.add_option("-n,--references", nrefs, "Number of references in each batch")->default_val(50);
+    std::vector<int> distances { 8, 32, 128 };
+    app.add_option("--prefetch-distance", distances, "Distances ahead in the index stream at which to prefetch, in entries");
+    bool warm;
+    app.add_flag("--warm", warm, "Skip the cache flush before each call");
+    int iterations;
+    app.add_option("-i,--iter", iterations, "Number of iterations")->default_val(20);
+    unsigned long long seed;
+    app.add_option("-s,--seed", seed, "Seed for the simulated data")->default_val(69);
+    CLI11_PARSE(app, argc, argv);
+
+    for (auto d : distances) {
+        if (d < 0) {
+            throw std::runtime_error("prefetch distances should be non-negative");
+        }
+    }
+
+    std::mt19937_64 rng(seed);
+
+    // Simulating the references in both sparse and dense form.
+    RankedVector negative, positive;
+    std::vector<std::pair<int, double> > buffer;
+    buffer.reserve(len);
+    ReferenceBlock block(len);
+    for (int r = 0; r < nrefs; ++r) {
+        simulate_sparse(len, density, rng, negative, positive);
+        append_reference(block, negative, positive, buffer);
+    }
+
+    const std::size_t stride = len;
+    std::vector<double> dense_refs(stride * nrefs);
+    for (int r = 0; r < nrefs; ++r) {
+        double* dense = dense_refs.data() + stride * r;
+        std::fill_n(dense, len, block.profile_zero(r));
+        const int num = block.num_nonzero(r);
+        const int* index = block.profile_index(r);
+        const double* value = block.profile_value(r);
+        for (int i = 0; i < num; ++i) {
+            dense[index[i]] = value[i];
+        }
+    }
+
+    // Simulating the query in the setup, in dense form and in sparse form with the entries in random order.
+    // We also compute the expected result here, as each kernel is timed separately (see below) and so sees a different sequence of queries.
+    // Afterwards, all of the data is flushed from the cache so that the next call starts cold.
+    std::vector<double> dense_query(len);
+    std::vector<std::pair<int, double> > sparse_query_unsorted;
+    double zero_query;
+    double expected;
+
+    eztimer::Options opt;
+    opt.iterations = iterations;
+    opt.setup = [&]() -> void {
+        simulate_sparse(len, density, rng, negative, positive);
+        scaled_ranks(len, negative, positive, sparse_query_unsorted, zero_query);
+        std::fill(dense_query.begin(), dense_query.end(), zero_query);
+        for (const auto& sq : sparse_query_unsorted) {
+            dense_query[sq.first] = sq.second;
+        }
+        std::shuffle(sparse_query_unsorted.begin(), sparse_query_unsorted.end(), rng);
+
+        expected = 0;
+        for (int r = 0; r < nrefs; ++r) {
+            expected += dense_sparse_unstable(len, dense_query.data(), block.num_nonzero(r), block.profile_index(r), block.profile_value(r), block.profile_zero(r)) * (r + 1);
+        }
+
+        if (!warm) {
+            flush_cache(dense_query.data(), dense_query.size() * sizeof(double));
+            flush_cache(sparse_query_unsorted.data(), sparse_query_unsorted.size() * sizeof(std::pair<int, double>));
+            flush_cache(block.index.data(), block.index.size() * sizeof(int));
+            flush_cache(block.value.data(), block.value.size() * sizeof(double));
+            flush_cache(dense_refs.data(), dense_refs.size() * sizeof(double));
+        }
+    };
+
+    // Each function returns a weighted sum of the L2 distances across the batch of references.
+    std::vector<std::function<double()> > funs;
+    std::vector<std::string> names;
+
+    names.push_back("dense-sparse-unstable");
+    funs.emplace_back([&]() -> double {
+        double total = 0;
+        for (int r = 0; r < nrefs; ++r) {
+            total += dense_sparse_unstable(len, dense_query.data(), block.num_nonzero(r), block.profile_index(r), block.profile_value(r), block.profile_zero(r)) * (r + 1);
+        }
+        return total;
+    });
+
+    for (const int dist : distances) {
+        names.push_back("dense-sparse-prefetch-" + std::to_string(dist));
+        funs.emplace_back([&,dist]() -> double {
+            double total = 0;
+            for (int r = 0; r < nrefs; ++r) {
+                const int next = r + 1;
+                if (next < nrefs) {
+                    prefetch_sparse_reference(block.profile_index(next), block.profile_value(next));
+                }
+                total += dense_sparse_unstable_prefetch(len, dense_query.data(), block.num_nonzero(r), block.profile_index(r), block.profile_value(r), block.profile_zero(r), dist) * (r + 1);
+            }
+            return total;
+        });
+    }
+
+    names.push_back("sparse-dense-unstable-unsorted");
+    funs.emplace_back([&]() -> double {
+        double total = 0;
+        for (int r = 0; r < nrefs; ++r) {
+            total += sparse_dense_unstable(len, sparse_query_unsorted.size(), sparse_query_unsorted.data(), zero_query, dense_refs.data() + stride * r) * (r + 1);
+        }
+        return total;
+    });
+
+    for (const int dist : distances) {
+        names.push_back("sparse-dense-prefetch-" + std::to_string(dist));
+        funs.emplace_back([&,dist]() -> double {
+            double total = 0;
+            const int num_query = sparse_query_unsorted.size();
+            for (int r = 0; r < nrefs; ++r) {
+                const int next = r + 1;
+                if (next < nrefs) {
+                    prefetch_dense_reference(num_query, sparse_query_unsorted.data(), dense_refs.data() + stride * next, dist);
+                }
+                total += sparse_dense_unstable_prefetch(len, num_query, sparse_query_unsorted.data(), zero_query, dense_refs.data() + stride * r, dist) * (r + 1);
+            }
+            return total;
+        });
+    }
+
+    // The setup is only run once before all kernels in each iteration, so if we timed them together, only the first kernel would start cold.
+    // Instead, we time each kernel on its own so that every call is immediately preceded by the setup and its flush.
+    auto time_one = [&](const std::size_t n) -> auto {
+        return eztimer::time<double>(
+            std::vector<std::function<double()> >{ funs[n] },
+            [&](const double& res, std::size_t) -> void {
+                if (std::abs(expected - res) > 1e-8 * std::abs(res)) {
+                    std::cout << expected << "\t" << res << "\t" << names[n] << std::endl;
+                    throw std::runtime_error("oops that's not right");
+                }
+            },
+            opt
+        );
+    };
+
+    auto res = time_one(0);
+    for (std::size_t n = 1; n < funs.size(); ++n) {
+        res.push_back(time_one(n).front());
+    }
+
+    for (std::size_t n = 0; n < names.size(); ++n) {
+        std::string nn = names[n];
+        nn.resize(32, ' ');
+        const double mu = res[n].mean.count();
+        const double se = res[n].sd.count() / std::sqrt(res[n].times.size());
+        std::cout << nn << ": " << mu << " ± " << (se / mu * 100) << " %" << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,103 @@
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include <algorithm>
+#include <utility>
+#include <cstddef>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// Software-prefetching versions of the gather-heavy kernels in l2_kernels.h.
+// At large lengths, each random gather from the dense query (or reference) is likely to miss the cache,
+// and the hardware prefetcher cannot predict the addresses as they depend on the index stream.
+// So, we prefetch the gather target for the entry that is 'distance' positions ahead of the current entry.
+// The main loop stops 'distance' entries early so that we never read past the end of the index stream.
+// 'distance' should be non-negative, otherwise the prefetch would read before the start of the index stream.
+
+inline double dense_sparse_unstable_prefetch(
+    const int num_markers,
+    const double* dense_query,
+    const int num_nonzero,
+    const int* sparse_ref_index,
+    const double* sparse_ref_value,
+    const double zero_ref,
+    const int distance
+) {
+    double l2 = 0;
+    int i = 0;
+    for (int end = num_nonzero - distance; i < end; ++i) {
+        __builtin_prefetch(dense_query + sparse_ref_index[i + distance]);
+        const double target = dense_query[sparse_ref_index[i]];
+        const double ref = sparse_ref_value[i] - zero_ref;
+        l2 += ref * (ref - 2 * target);
+    }
+    for (; i < num_nonzero; ++i) {
+        const double target = dense_query[sparse_ref_index[i]];
+        const double ref = sparse_ref_value[i] - zero_ref;
+        l2 += ref * (ref - 2 * target);
+    }
+    const double x2 = (num_nonzero == 0 ? 0 : 0.25);
+    return x2 + l2 - num_markers * zero_ref * zero_ref;
+}
+
+inline double sparse_dense_unstable_prefetch(
+    const int num_markers,
+    const int num_query,
+    const std::pair<int, double>* sparse_query,
+    const double zero_query,
+    const double* dense_ref,
+    const int distance
+) {
+    double l2 = 0;
+    int i = 0;
+    for (int end = num_query - distance; i < end; ++i) {
+        __builtin_prefetch(dense_ref + sparse_query[i + distance].first);
+        const auto& current = sparse_query[i];
+        const double target = dense_ref[current.first];
+        const double query = current.second - zero_query;
+        l2 += query * (query - 2 * target);
+    }
+    for (; i < num_query; ++i) {
+        const auto& current = sparse_query[i];
+        const double target = dense_ref[current.first];
+        const double query = current.second - zero_query;
+        l2 += query * (query - 2 * target);
+    }
+    const double x2 = (num_query == 0 ? 0 : 0.25);
+    return x2 + l2 - num_markers * zero_query * zero_query;
+}
+
+// When iterating over a batch of references, the start of the next reference is prefetched before computing the current one,
+// so that the first few iterations of the next kernel call do not stall before the in-loop prefetches take effect.
+// For sparse references, this prefetches the first cache line of the index and value arrays.
+// We don't prefetch the gather targets, as that would stall on loading the (cold) indices.
+inline void prefetch_sparse_reference(const int* sparse_ref_index, const double* sparse_ref_value) {
+    __builtin_prefetch(sparse_ref_index);
+    __builtin_prefetch(sparse_ref_value);
+}
+
+// For dense references, this prefetches the first 'distance' gather targets of the sparse query.
+inline void prefetch_dense_reference(const int num_query, const std::pair<int, double>* sparse_query, const double* dense_ref, const int distance) {
+    for (int i = 0, end = std::min(distance, num_query); i < end; ++i) {
+        __builtin_prefetch(dense_ref + sparse_query[i].first);
+    }
+}
+
+// Evicts a range of memory from all cache levels, for cold-cache timings.
+// This is a no-op on non-x86 architectures, in which case the timings will be warm.
+inline void flush_cache(const void* ptr, const std::size_t bytes) {
+#if defined(__x86_64__) || defined(__i386__)
+    const char* start = static_cast<const char*>(ptr);
+    for (std::size_t offset = 0; offset < bytes; offset += 64) {
+        _mm_clflush(start + offset);
+    }
+    _mm_mfence();
+#else
+    (void)ptr;
+    (void)bytes;
+#endif
+}
+
+#endif
@@ -0,0 +1,160 @@
+#include "eztimer/eztimer.hpp"
+
+#include "CLI/App.hpp"
+#include "CLI/Formatter.hpp"
+#include "CLI/Config.hpp"
+
+#include "scaled_ranks.h"
+#include "simulate.h"
+#include "l2_kernels.h"
+#include "quantile_scorer.h"
+
+#include <random>
+#include <vector>
+#include <optional>
+#include <iostream>
+#include <stdexcept>
+
+int main(int argc, char ** argv) {
+    CLI::App app{"Per-label quantile scoring performance tests"};
+    int len;
+    app.add_option("-l,--length", len, "Length of the simulated vector")->default_val(1000);
+    double density;
+    app.add_option("-d,--density", density, "Density of non-zero elements in the simulated vector")->default_val(0.2);
+    std::vector<int> label_sizes { 10, 100, 1000, 10000 };
+    app.add_option("-n,--references", label_sizes, "Number of references in each label");
+    double quantile;
+    app.add_option("-q,--quantile", quantile, "Quantile of the correlations to use as the score")->default_val(0.8);
+    int iterations;
+    app.add_option("-i,--iter", iterations, "Number of iterations")->default_val(100);
+    unsigned long long seed;
+    app.add_option("-s,--seed", seed, "Seed for the simulated data")->default_val(69);
+    CLI11_PARSE(app, argc, argv);
+
+    if (!(quantile >= 0 && quantile <= 1)) {
+        throw std::runtime_error("quantile should lie in [0, 1]");
+    }
+
+    // Empty labels have no quantile, and would also divide by zero when splitting the pool and reporting the time per label.
+    if (label_sizes.empty()) {
+        throw std::runtime_error("at least one label size should be specified");
+    }
+    for (auto nlabel : label_sizes) {
+        if (nlabel < 1) {
+            throw std::runtime_error("each label should contain at least one reference");
+        }
+    }
+
+    std::mt19937_64 rng(seed);
+
+    // Setting up a pool of references that is large enough for the biggest label.
+    const int nrefs = *std::max_element(label_sizes.begin(), label_sizes.end());
+    RankedVector negative, positive;
+    std::vector<std::pair<int, double> > buffer;
+    buffer.reserve(len);
+    std::vector<double> zero_refs(nrefs);
+    std::vector<std::vector<int> > sparse_ref_index(nrefs);
+    std::vector<std::vector<double> > sparse_ref_value(nrefs);
+
+    for (int r = 0; r < nrefs; ++r) {
+        simulate_sparse(len, density, rng, negative, positive);
+        scaled_ranks(len, negative, positive, buffer, zero_refs[r]);
+        std::sort(buffer.begin(), buffer.end());
+        for (const auto& b : buffer) {
+            sparse_ref_index[r].push_back(b.first);
+            sparse_ref_value[r].push_back(b.second);
+        }
+    }
+
+    std::vector<std::pair<int, double> > sparse_query;
+    sparse_query.reserve(len);
+    double zero_query;
+    std::vector<double> dense_query(len);
+    std::vector<double> l2(nrefs);
+    std::optional<double> result;
+
+    for (auto nlabel : label_sizes) {
+        // Splitting the pool into labels of the requested size, so the total number of L2 norms is the same for each size.
+        const int nlabels = nrefs / nlabel;
+
+        eztimer::Options opt;
+        opt.iterations = iterations;
+        opt.setup = [&]() -> void {
+            simulate_sparse(len, density, rng, negative, positive);
+            scaled_ranks(len, negative, positive, sparse_query, zero_query);
+            std::fill(dense_query.begin(), dense_query.end(), zero_query);
+            for (const auto& sq : sparse_query) {
+                dense_query[sq.first] = sq.second;
+            }
+
+            // The L2 norms are precomputed so that we only time the scoring itself.
+            for (int r = 0; r < nrefs; ++r) {
+                l2[r] = dense_sparse_unstable(len, dense_query.data(), sparse_ref_index[r].size(), sparse_ref_index[r].data(), sparse_ref_value[r].data(), zero_refs[r]);
+            }
+
+            result.reset();
+        };
+
+        std::vector<std::function<double()> > funs;
+        std::vector<std::string> names;
+
+        names.push_back("collect-nth_element");
+        std::vector<double> correlations;
+        correlations.reserve(nlabel);
+        funs.emplace_back([&]() -> double {
+            double total = 0;
+            for (int l = 0; l < nlabels; ++l) {
+                correlations.clear();
+                const double* current = l2.data() + static_cast<std::size_t>(l) * nlabel;
+                for (int r = 0; r < nlabel; ++r) {
+                    correlations.push_back(l2_to_correlation(current[r]));
+                }
+                total += collect_quantile(correlations, quantile);
+            }
+            return total;
+        });
+
+        names.push_back("streaming-heap");
+        QuantileScorer scorer(quantile);
+        funs.emplace_back([&]() -> double {
+            double total = 0;
+            for (int l = 0; l < nlabels; ++l) {
+                scorer.reset(nlabel);
+                const double* current = l2.data() + static_cast<std::size_t>(l) * nlabel;
+                for (int r = 0; r < nlabel; ++r) {
+                    scorer.add_l2(current[r]);
+                }
+                total += scorer.score();
+            }
+            return total;
+        });
+
+        // Performing the iterations.
+        auto res = eztimer::time<double>(
+            funs,
+            [&](const double& res, std::size_t i) -> void {
+                if (result.has_value()) {
+                    if (std::abs(*result - res) / std::abs(res) > 1e-8) {
+                        std::cout << *result << "\t" << res << "\t" << names[i] << std::endl;
+                        throw std::runtime_error("oops that's not right");
+                    }
+                } else {
+                    result = res;
+                }
+            },
+            opt
+        );
+
+        std::cout << nlabels << " labels of " << nlabel << " references (time per label)" << std::endl;
+        for (std::size_t n = 0; n < names.size(); ++n) {
+            std::string nn = names[n];
+            nn.resize(32, ' ');
+            const double mu = res[n].mean.count() / nlabels;
+            const double se = res[n].sd.count() / nlabels / std::sqrt(res[n].times.size());
+            std::cout << nn << ": " << mu << " ± " << (se / mu * 100) << " %" << std::endl;
+        }
+        std::cout << std::endl;
+    }
+
+    return 0;
+}
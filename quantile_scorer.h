@@ -0,0 +1,154 @@
+#ifndef QUANTILE_SCORER_H
+#define QUANTILE_SCORER_H
+
+#include <algorithm>
+#include <vector>
+#include <functional>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+// Converting the L2 norm between two scaled rank vectors into Spearman's correlation.
+// Each vector has a sum of squares of 0.25, so the L2 norm is equal to 0.5 - 0.5 * rho.
+// We clamp the result in case the unstable kernels give us something slightly out of range.
+inline double l2_to_correlation(const double l2) {
+    return std::max(-1.0, std::min(1.0, 1 - 2 * l2));
+}
+
+// Computing the quantile of the correlations for a label in the same manner as singlepp,
+// i.e., by linear interpolation between the two closest order statistics.
+// This modifies the input vector.
+// The quantile should lie in [0, 1]; this is not checked here as it is called for every label, so callers should validate it once beforehand.
+inline double collect_quantile(std::vector<double>& correlations, const double quantile) {
+    const std::size_t num = correlations.size();
+    if (num == 0) {
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+    if (quantile == 1 || num == 1) {
+        return *std::max_element(correlations.begin(), correlations.end());
+    }
+
+    const double prod = (num - 1) * quantile;
+    const std::size_t left = std::floor(prod);
+    const std::size_t right = std::ceil(prod);
+
+    std::nth_element(correlations.begin(), correlations.begin() + right, correlations.end());
+    const double rightval = correlations[right];
+    if (right == left) {
+        return rightval;
+    }
+
+    std::nth_element(correlations.begin(), correlations.begin() + left, correlations.begin() + right);
+    const double leftval = correlations[left];
+    return rightval * (prod - left) + leftval * (right - prod);
+}
+
+// Streaming alternative to collect_quantile().
+// Given the number of references in a label, we only need to keep the largest correlations that might be used in the interpolation.
+// These are stored in a bounded min-heap so that each new correlation is either discarded in O(1) or inserted in O(log k).
+class QuantileScorer {
+public:
+    QuantileScorer(const double quantile) : my_quantile(quantile) {
+        // Quantiles outside [0, 1] would give order statistics outside of the label, and negative quantiles would wrap around to huge heap sizes.
+        if (!(quantile >= 0 && quantile <= 1)) {
+            throw std::runtime_error("quantile should lie in [0, 1]");
+        }
+    }
+
+    void reset(const std::size_t num_references) {
+        my_heap.clear();
+        my_num = num_references;
+        if (my_num == 0) {
+            my_keep = 0;
+            return;
+        }
+
+        if (my_quantile == 1 || my_num == 1) {
+            my_left = my_num - 1;
+            my_right = my_left;
+        } else {
+            my_prod = (my_num - 1) * my_quantile;
+            my_left = std::floor(my_prod);
+            my_right = std::ceil(my_prod);
+        }
+
+        my_keep = my_num - my_left;
+        my_heap.reserve(my_keep);
+    }
+
+private:
+    double my_quantile;
+    std::size_t my_num = 0, my_keep = 0, my_left = 0, my_right = 0;
+    double my_prod = 0;
+    std::vector<double> my_heap;
+
+public:
+    void add(const double correlation) {
+        // Filling the buffer before heapifying it in one go, which is cheaper than pushing each value.
+        if (my_heap.size() < my_keep) {
+            my_heap.push_back(correlation);
+            if (my_heap.size() == my_keep) {
+                std::make_heap(my_heap.begin(), my_heap.end(), std::greater<double>());
+            }
+        } else if (correlation > my_heap.front()) {
+            replace_top(correlation);
+        }
+    }
+
+private:
+    // Replacing the root and sifting it down, which only needs one pass instead of std::pop_heap() followed by std::push_heap().
+    void replace_top(const double correlation) {
+        const std::size_t num = my_heap.size();
+        double* heap = my_heap.data();
+        std::size_t current = 0;
+        while (1) {
+            std::size_t child = 2 * current + 1;
+            if (child >= num) {
+                break;
+            }
+            if (child + 1 < num && heap[child + 1] < heap[child]) {
+                ++child;
+            }
+            if (heap[child] >= correlation) {
+                break;
+            }
+            heap[current] = heap[child];
+            current = child;
+        }
+        heap[current] = correlation;
+    }
+
+public:
+
+    void add_l2(const double l2) {
+        add(l2_to_correlation(l2));
+    }
+
+    // Any reference with an L2 norm above this bound cannot change the score, so it can be abandoned early.
+    double l2_bound() const {
+        if (my_heap.size() < my_keep) {
+            return std::numeric_limits<double>::infinity();
+        }
+        return (1 - my_heap.front()) / 2;
+    }
+
+    // Should only be called after all num_references correlations have been added.
+    double score() const {
+        if (my_num == 0) {
+            return std::numeric_limits<double>::quiet_NaN();
+        }
+
+        // The root of the heap is the order statistic at 'left', and the next smallest must be one of its children.
+        const double leftval = my_heap.front();
+        if (my_right == my_left) {
+            return leftval;
+        }
+        double rightval = my_heap[1];
+        if (my_heap.size() > 2) {
+            rightval = std::min(rightval, my_heap[2]);
+        }
+        return rightval * (my_prod - my_left) + leftval * (my_right - my_prod);
+    }
+};
+
+#endif
@@ -0,0 +1,179 @@
+#include "eztimer/eztimer.hpp"
+
+#include "CLI/App.hpp"
+#include "CLI/Formatter.hpp"
+#include "CLI/Config.hpp"
+
+#include "scaled_ranks.h"
+#include "simulate.h"
+#include "l2_kernels.h"
+#include "reference_file.h"
+#include "quantized.h"
+
+#include <random>
+#include <vector>
+#include <iostream>
+#include <cstdint>
+
+int main(int argc, char ** argv) {
+    CLI::App app{"int8 quantized L2 performance tests"};
+    int len;
+    app.add_option("-l,--length", len, "Length of the simulated vector")->default_val(1000);
+    double density;
+    app.add_option("-d,--density", density, "Density of non-zero elements in the simulated vector")->default_val(0.2);
+    int nrefs;
+    app.add_option("-n,--references", nrefs, "Number of references")->default_val(1000);
+    int iterations;
+    app.add_option("-i,--iter", iterations, "Number of iterations")->default_val(100);
+    unsigned long long seed;
+    app.add_option("-s,--seed", seed, "Seed for the simulated data")->default_val(69);
+    CLI11_PARSE(app, argc, argv);
+
+    std::mt19937_64 rng(seed);
+
+    // Simulating the references, and storing them in sparse, dense and quantized forms.
+    RankedVector negative, positive;
+    std::vector<std::pair<int, double> > buffer;
+    buffer.reserve(len);
+    ReferenceBlock block(len);
+    for (int r = 0; r < nrefs; ++r) {
+        simulate_sparse(len, density, rng, negative, positive);
+        append_reference(block, negative, positive, buffer);
+    }
+
+    const std::size_t stride = len;
+    std::vector<double> dense_refs(stride * nrefs);
+    std::vector<std::int8_t> quantized_refs(stride * nrefs);
+    std::vector<QuantizedScale> ref_scales(nrefs);
+    for (int r = 0; r < nrefs; ++r) {
+        double* dense = dense_refs.data() + stride * r;
+        std::fill_n(dense, len, block.profile_zero(r));
+        const int num = block.num_nonzero(r);
+        const int* index = block.profile_index(r);
+        const double* value = block.profile_value(r);
+        for (int i = 0; i < num; ++i) {
+            dense[index[i]] = value[i];
+        }
+        ref_scales[r] = quantize_sparse(len, num, index, value, block.profile_zero(r), quantized_refs.data() + stride * r);
+    }
+
+    // Simulating the query in the setup, along with the exact L2 norms for comparison.
+    std::vector<std::pair<int, double> > sparse_query;
+    sparse_query.reserve(len);
+    double zero_query;
+    std::vector<double> dense_query(len);
+    std::vector<double> truth(nrefs);
+    double truth_sum = 0;
+
+    eztimer::Options opt;
+    opt.iterations = iterations;
+    opt.setup = [&]() -> void {
+        simulate_sparse(len, density, rng, negative, positive);
+        scaled_ranks(len, negative, positive, sparse_query, zero_query);
+        std::fill(dense_query.begin(), dense_query.end(), zero_query);
+        for (const auto& sq : sparse_query) {
+            dense_query[sq.first] = sq.second;
+        }
+
+        truth_sum = 0;
+        for (int r = 0; r < nrefs; ++r) {
+            truth[r] = dense_dense(len, dense_query.data(), dense_refs.data() + stride * r);
+            truth_sum += truth[r];
+        }
+    };
+
+    // Setting up the functions. Each function stores the L2 norm for each reference, for computing the errors later.
+    std::vector<std::function<double()> > funs;
+    std::vector<std::string> names;
+    std::vector<std::vector<double> > found;
+    std::vector<unsigned char> approximate;
+
+    names.push_back("dense-dense");
+    found.emplace_back(nrefs);
+    approximate.push_back(0);
+    funs.emplace_back([&]() -> double {
+        auto& current = found[0];
+        double total = 0;
+        for (int r = 0; r < nrefs; ++r) {
+            current[r] = dense_dense(len, dense_query.data(), dense_refs.data() + stride * r);
+            total += current[r];
+        }
+        return total;
+    });
+
+    names.push_back("dense-sparse-unstable");
+    found.emplace_back(nrefs);
+    approximate.push_back(0);
+    funs.emplace_back([&]() -> double {
+        auto& current = found[1];
+        double total = 0;
+        for (int r = 0; r < nrefs; ++r) {
+            current[r] = dense_sparse_unstable(len, dense_query.data(), block.num_nonzero(r), block.profile_index(r), block.profile_value(r), block.profile_zero(r));
+            total += current[r];
+        }
+        return total;
+    });
+
+    // The query is quantized inside the timed function, as this is part of the cost of the quantized pass.
+    names.push_back("quantized-int8");
+    found.emplace_back(nrefs);
+    approximate.push_back(1);
+    std::vector<std::int8_t> quantized_query(len);
+    funs.emplace_back([&]() -> double {
+        auto& current = found[2];
+        const auto query_scale = quantize_dense(len, dense_query.data(), quantized_query.data());
+        double total = 0;
+        for (int r = 0; r < nrefs; ++r) {
+            current[r] = quantized_l2(len, quantized_query.data(), query_scale, quantized_refs.data() + stride * r, ref_scales[r]);
+            total += current[r];
+        }
+        return total;
+    });
+
+    // Performing the iterations. Exact kernels must match the truth, while the approximate kernels are only checked for their errors.
+    std::vector<std::vector<double> > errors(funs.size());
+    auto res = eztimer::time<double>(
+        funs,
+        [&](const double& res, std::size_t i) -> void {
+            if (!approximate[i]) {
+                if (std::abs(truth_sum - res) / res > 1e-8) {
+                    std::cout << truth_sum << "\t" << res << "\t" << names[i] << std::endl;
+                    throw std::runtime_error("oops that's not right");
+                }
+                return;
+            }
+
+            // Errors are reported on the correlation scale, i.e., 1 - 2 * L2.
+            for (int r = 0; r < nrefs; ++r) {
+                errors[i].push_back(2 * std::abs(found[i][r] - truth[r]));
+            }
+        },
+        opt
+    );
+
+    const double baseline = res[0].mean.count();
+    for (std::size_t n = 0; n < names.size(); ++n) {
+        std::string nn = names[n];
+        nn.resize(32, ' ');
+        const double mu = res[n].mean.count();
+        const double se = res[n].sd.count() / std::sqrt(res[n].times.size());
+        std::cout << nn << ": " << mu << " ± " << (se / mu * 100) << " %, " << (nrefs / mu / 1e6) << " M refs/s, speedup = " << baseline / mu << std::endl;
+    }
+
+    std::cout << std::endl << "Absolute error in the correlations (median / 90% / 99% / max):" << std::endl;
+    for (std::size_t n = 0; n < names.size(); ++n) {
+        if (!approximate[n]) {
+            continue;
+        }
+        auto& current = errors[n];
+        std::sort(current.begin(), current.end());
+        auto quantile = [&](double q) -> double {
+            return current[std::min(current.size() - 1, static_cast<std::size_t>(q * current.size()))];
+        };
+        std::string nn = names[n];
+        nn.resize(32, ' ');
+        std::cout << nn << ": " << quantile(0.5) << " / " << quantile(0.9) << " / " << quantile(0.99) << " / " << current.back() << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,159 @@
+#ifndef QUANTIZED_H
+#define QUANTIZED_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+#if defined(__AVX512BW__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// int8 quantization of scaled ranks for a coarse first pass over the references, where some error is tolerable.
+// Each profile is stored as int8 values in [-127, 127] with its own scale, i.e., the scaled rank of marker i is approximately scale * q[i].
+// We also store the sum of squares of the dequantized values, so that the L2 norm is that between the dequantized vectors.
+struct QuantizedScale {
+    double scale = 0;
+    double sum_squares = 0;
+};
+
+inline QuantizedScale quantize_dense(const int num_markers, const double* dense, std::int8_t* quantized) {
+    QuantizedScale output;
+    double max_abs = 0;
+    for (int i = 0; i < num_markers; ++i) {
+        max_abs = std::max(max_abs, std::abs(dense[i]));
+    }
+
+    // No-variance profiles have all-zero scaled ranks, which are preserved exactly.
+    if (max_abs == 0) {
+        std::fill_n(quantized, num_markers, 0);
+        return output;
+    }
+
+    output.scale = max_abs / 127;
+    const double inverse = 127 / max_abs;
+    std::int64_t sum_squares = 0;
+    for (int i = 0; i < num_markers; ++i) {
+        const int q = std::lround(dense[i] * inverse);
+        quantized[i] = q;
+        sum_squares += q * q;
+    }
+    output.sum_squares = output.scale * output.scale * sum_squares;
+    return output;
+}
+
+// Quantizing a sparse profile from scaled_ranks() into a dense int8 array.
+// The non-zero values must be in [0, num_markers), but need not be sorted.
+inline QuantizedScale quantize_sparse(
+    const int num_markers,
+    const int num_nonzero,
+    const int* sparse_index,
+    const double* sparse_value,
+    const double zero,
+    std::int8_t* quantized
+) {
+    QuantizedScale output;
+    double max_abs = (num_nonzero < num_markers ? std::abs(zero) : 0);
+    for (int i = 0; i < num_nonzero; ++i) {
+        max_abs = std::max(max_abs, std::abs(sparse_value[i]));
+    }
+
+    if (max_abs == 0) {
+        std::fill_n(quantized, num_markers, 0);
+        return output;
+    }
+
+    output.scale = max_abs / 127;
+    const double inverse = 127 / max_abs;
+    const int qzero = std::lround(zero * inverse);
+    std::fill_n(quantized, num_markers, qzero);
+    for (int i = 0; i < num_nonzero; ++i) {
+        quantized[sparse_index[i]] = std::lround(sparse_value[i] * inverse);
+    }
+
+    std::int64_t sum_squares = 0;
+    for (int i = 0; i < num_markers; ++i) {
+        const int q = quantized[i];
+        sum_squares += q * q;
+    }
+    output.sum_squares = output.scale * output.scale * sum_squares;
+    return output;
+}
+
+// Dot product of two int8 arrays, computed exactly for any num_markers.
+// The total can exceed INT32_MAX beyond INT32_MAX / 127^2 (~133k) markers, so it is accumulated in 64 bits.
+// pmaddubsw multiplies unsigned by signed bytes, so we use |a| and sign(a) * b, which gives the same products.
+// Each pair of products is at most 2 * 127^2, which fits in an int16 without saturation.
+// Each int32 lane then absorbs 4 products per step, so it can safely take INT32_MAX / (4 * 127^2) steps
+// before we need to widen the accumulator into the 64-bit total.
+inline std::int64_t quantized_dot(const int num_markers, const std::int8_t* left, const std::int8_t* right) {
+    std::int64_t dot = 0;
+    int i = 0;
+
+#if defined(__AVX512BW__) || defined(__AVX2__)
+    constexpr std::int64_t steps_per_flush = std::numeric_limits<std::int32_t>::max() / (4 * 127 * 127);
+#endif
+
+#if defined(__AVX512BW__)
+    constexpr int width = 64;
+#if !defined(__AVX512VNNI__)
+    const __m512i ones = _mm512_set1_epi16(1);
+#endif
+    while (i + width <= num_markers) {
+        __m512i acc = _mm512_setzero_si512();
+        for (std::int64_t s = 0; s < steps_per_flush && i + width <= num_markers; ++s, i += width) {
+            const __m512i a = _mm512_loadu_si512(left + i);
+            const __m512i b = _mm512_loadu_si512(right + i);
+            // There is no AVX-512 version of psignb, so we negate 'b' wherever 'a' is negative.
+            const __m512i abs_a = _mm512_abs_epi8(a);
+            const __m512i signed_b = _mm512_mask_sub_epi8(b, _mm512_movepi8_mask(a), _mm512_setzero_si512(), b);
+#if defined(__AVX512VNNI__)
+            acc = _mm512_dpbusd_epi32(acc, abs_a, signed_b);
+#else
+            acc = _mm512_add_epi32(acc, _mm512_madd_epi16(_mm512_maddubs_epi16(abs_a, signed_b), ones));
+#endif
+        }
+        alignas(64) std::int32_t lanes[16];
+        _mm512_store_si512(lanes, acc);
+        for (auto l : lanes) {
+            dot += l;
+        }
+    }
+#elif defined(__AVX2__)
+    constexpr int width = 32;
+    const __m256i ones = _mm256_set1_epi16(1);
+    while (i + width <= num_markers) {
+        __m256i acc = _mm256_setzero_si256();
+        for (std::int64_t s = 0; s < steps_per_flush && i + width <= num_markers; ++s, i += width) {
+            const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(left + i));
+            const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(right + i));
+            const __m256i prod = _mm256_maddubs_epi16(_mm256_sign_epi8(a, a), _mm256_sign_epi8(b, a));
+            acc = _mm256_add_epi32(acc, _mm256_madd_epi16(prod, ones));
+        }
+        alignas(32) std::int32_t lanes[8];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), acc);
+        for (auto l : lanes) {
+            dot += l;
+        }
+    }
+#endif
+
+    for (; i < num_markers; ++i) {
+        dot += static_cast<std::int32_t>(left[i]) * static_cast<std::int32_t>(right[i]);
+    }
+    return dot;
+}
+
+inline double quantized_l2(
+    const int num_markers,
+    const std::int8_t* query,
+    const QuantizedScale& query_scale,
+    const std::int8_t* ref,
+    const QuantizedScale& ref_scale
+) {
+    const double dot = query_scale.scale * ref_scale.scale * quantized_dot(num_markers, query, ref);
+    return query_scale.sum_squares + ref_scale.sum_squares - 2 * dot;
+}
+
+#endif
@@ -0,0 +1,232 @@
+#include "eztimer/eztimer.hpp"
+
+#include "CLI/App.hpp"
+#include "CLI/Formatter.hpp"
+#include "CLI/Config.hpp"
+
+#include "scaled_ranks.h"
+#include "simulate.h"
+#include "query_context.h"
+
+#include <random>
+#include <vector>
+#include <optional>
+#include <iostream>
+#include <iomanip>
+#include <cmath>
+
+int main(int argc, char ** argv) {
+    CLI::App app{"Query context amortisation tests"};
+    int len;
+    app.add_option("-l,--length", len, "Length of the simulated vector")->default_val(1000);
+    double density;
+    app.add_option("-d,--density", density, "Density of non-zero elements in the simulated vector")->default_val(0.2);
+    int iterations;
+    app.add_option("-i,--iter", iterations, "Number of iterations")->default_val(100);
+    unsigned long long seed;
+    app.add_option("-s,--seed", seed, "Seed for the simulated data")->default_val(69);
+    CLI11_PARSE(app, argc, argv);
+
+    // Setting up all of the data structures.
+    RankedVector negative_query, positive_query;
+    QueryContext context(len), fresh(len), fresh_index_sorted(len), fresh_dense(len);
+
+    RankedVector negative_ref, positive_ref;
+    std::vector<std::pair<int, double> > sparse_ref;
+    sparse_ref.reserve(len);
+    std::vector<int> sparse_ref_index;
+    sparse_ref_index.reserve(len);
+    std::vector<double> sparse_ref_value;
+    sparse_ref_value.reserve(len);
+    double zero_ref;
+    std::vector<double> dense_ref(len);
+
+    std::optional<double> result;
+    std::mt19937_64 rng(seed);
+
+    eztimer::Options opt;
+    opt.iterations = iterations;
+    opt.setup = [&]() -> void {
+        simulate_sparse(len, density, rng, negative_query, positive_query);
+        context.reset(negative_query, positive_query);
+        context.prepare();
+        fresh_index_sorted.reset(negative_query, positive_query);
+        fresh_dense.reset(negative_query, positive_query);
+
+        simulate_sparse(len, density, rng, negative_ref, positive_ref);
+        scaled_ranks(len, negative_ref, positive_ref, sparse_ref, zero_ref);
+        std::sort(sparse_ref.begin(), sparse_ref.end());
+        sparse_ref_index.clear();
+        sparse_ref_value.clear();
+        std::fill(dense_ref.begin(), dense_ref.end(), zero_ref);
+        for (const auto& sr : sparse_ref) {
+            sparse_ref_index.push_back(sr.first);
+            sparse_ref_value.push_back(sr.second);
+            dense_ref[sr.first] = sr.second;
+        }
+
+        result.reset();
+    };
+
+    // Setting up the functions to build each form of the query.
+    // The index-sorted and dense forms are built from a context that was reset in the setup, so that we only time the incremental cost of each form.
+    // These are not checked as they don't compute an L2 norm.
+    std::vector<std::function<double()> > funs;
+    std::vector<std::string> names;
+    std::vector<bool> is_kernel;
+
+    names.push_back("build-value-sorted");
+    is_kernel.push_back(false);
+    funs.emplace_back([&]() -> double {
+        fresh.reset(negative_query, positive_query);
+        return fresh.value_sorted().size();
+    });
+
+    names.push_back("build-index-sorted");
+    is_kernel.push_back(false);
+    funs.emplace_back([&]() -> double {
+        return fresh_index_sorted.index_sorted().size();
+    });
+
+    names.push_back("build-dense");
+    is_kernel.push_back(false);
+    funs.emplace_back([&]() -> double {
+        return fresh_dense.dense().size();
+    });
+
+    // Setting up the kernels, along with the query form that each of them needs.
+    std::vector<int> requires_form;
+    const int needs_value_sorted = 0, needs_index_sorted = 1, needs_dense = 2;
+
+    names.push_back("dense-dense");
+    is_kernel.push_back(true);
+    requires_form.push_back(needs_dense);
+    funs.emplace_back([&]() -> double {
+        return dense_dense(context, dense_ref.data());
+    });
+
+    names.push_back("sparse-dense-interleaved");
+    is_kernel.push_back(true);
+    requires_form.push_back(needs_index_sorted);
+    funs.emplace_back([&]() -> double {
+        return sparse_dense_interleaved(context, dense_ref.data());
+    });
+
+    names.push_back("dense-sparse-interleaved");
+    is_kernel.push_back(true);
+    requires_form.push_back(needs_dense);
+    funs.emplace_back([&]() -> double {
+        return dense_sparse_interleaved(context, sparse_ref_index.size(), sparse_ref_index.data(), sparse_ref_value.data(), zero_ref);
+    });
+
+    names.push_back("dense-sparse-densified");
+    is_kernel.push_back(true);
+    requires_form.push_back(needs_dense);
+    std::vector<double> buffer_ds(len);
+    funs.emplace_back([&]() -> double {
+        return dense_sparse_densified(context, sparse_ref_index.size(), sparse_ref_index.data(), sparse_ref_value.data(), zero_ref, buffer_ds.data());
+    });
+
+    names.push_back("dense-sparse-unstable");
+    is_kernel.push_back(true);
+    requires_form.push_back(needs_dense);
+    funs.emplace_back([&]() -> double {
+        return dense_sparse_unstable(context, sparse_ref_index.size(), sparse_ref_index.data(), sparse_ref_value.data(), zero_ref);
+    });
+
+    names.push_back("sparse-dense-unstable-unsorted");
+    is_kernel.push_back(true);
+    requires_form.push_back(needs_value_sorted);
+    funs.emplace_back([&]() -> double {
+        return sparse_dense_unstable(context, dense_ref.data());
+    });
+
+    names.push_back("sparse-sparse-interleaved");
+    is_kernel.push_back(true);
+    requires_form.push_back(needs_index_sorted);
+    funs.emplace_back([&]() -> double {
+        return sparse_sparse_interleaved(context, sparse_ref_index.size(), sparse_ref_index.data(), sparse_ref_value.data(), zero_ref);
+    });
+
+    // Performing the iterations.
+    auto res = eztimer::time<double>(
+        funs,
+        [&](const double& res, std::size_t i) -> void {
+            if (!is_kernel[i]) {
+                return;
+            }
+            if (result.has_value()) {
+                if (std::abs(*result - res) / res > 1e-8) {
+                    std::cout << *result << "\t" << res << "\t" << names[i] << std::endl;
+                    throw std::runtime_error("oops that's not right");
+                }
+            } else {
+                result = res;
+            }
+        },
+        opt
+    );
+
+    for (std::size_t n = 0; n < names.size(); ++n) {
+        std::string nn = names[n];
+        nn.resize(32, ' ');
+        const double mu = res[n].mean.count(); 
+        const double se = res[n].sd.count() / std::sqrt(res[n].times.size());
+        std::cout << nn << ": " << mu << " ± " << (se / mu * 100) << " %" << std::endl;
+    }
+
+    // Reporting the total cost of scoring one query against N references, including the cost of building the query form required by each kernel.
+    // The value-sorted form is always needed to compute the scaled ranks, so only the additional cost of each form is counted.
+    const double form_cost[3] = { 0, res[1].mean.count(), res[2].mean.count() };
+    const std::vector<int> num_refs { 1, 10, 100, 1000, 10000 };
+
+    std::cout << std::endl << "Total cost per query for N references" << std::endl;
+    std::string header = "N";
+    header.resize(32, ' ');
+    std::cout << header;
+    for (auto nr : num_refs) {
+        std::cout << std::setw(14) << nr;
+    }
+    std::cout << std::endl;
+
+    const std::size_t first_kernel = names.size() - requires_form.size();
+    for (std::size_t k = 0; k < requires_form.size(); ++k) {
+        std::string nn = names[first_kernel + k];
+        nn.resize(32, ' ');
+        std::cout << nn;
+        for (auto nr : num_refs) {
+            std::cout << std::setw(14) << form_cost[requires_form[k]] + nr * res[first_kernel + k].mean.count();
+        }
+        std::cout << std::endl;
+    }
+
+    // Reporting the break-even point for each kernel, i.e., the number of references beyond which building its query form pays off
+    // compared to sparse-dense-unstable-unsorted, which only needs the value-sorted form that is always available.
+    std::size_t baseline = 0;
+    for (std::size_t k = 0; k < requires_form.size(); ++k) {
+        if (names[first_kernel + k] == "sparse-dense-unstable-unsorted") {
+            baseline = k;
+        }
+    }
+    const double baseline_form = form_cost[requires_form[baseline]];
+    const double baseline_call = res[first_kernel + baseline].mean.count();
+
+    std::cout << std::endl << "Break-even number of references relative to " << names[first_kernel + baseline] << std::endl;
+    for (std::size_t k = 0; k < requires_form.size(); ++k) {
+        if (k == baseline) {
+            continue;
+        }
+        std::string nn = names[first_kernel + k];
+        nn.resize(32, ' ');
+        std::cout << nn << ": ";
+        const double extra_form = form_cost[requires_form[k]] - baseline_form;
+        const double saved_per_call = baseline_call - res[first_kernel + k].mean.count();
+        if (saved_per_call <= 0) {
+            std::cout << "never" << std::endl;
+        } else {
+            std::cout << std::ceil(extra_form / saved_per_call) << std::endl;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,116 @@
+#ifndef QUERY_CONTEXT_H
+#define QUERY_CONTEXT_H
+
+#include <algorithm>
+#include <vector>
+#include <utility>
+
+#include "scaled_ranks.h"
+#include "l2_kernels.h"
+
+// All representations of a query's scaled ranks, built once and reused across many L2 calculations.
+// The value-sorted sparse form is computed by scaled_ranks() on construction;
+// the index-sorted sparse form and the dense form are only created on first use, so a caller only pays for the forms that its kernels need.
+// Note that the lazy creation is not thread-safe, so each thread should use its own context or call prepare() beforehand.
+class QueryContext {
+public:
+    QueryContext(const int num_markers) : my_num_markers(num_markers) {
+        my_value_sorted.reserve(num_markers);
+    }
+
+    QueryContext(const int num_markers, const RankedVector& negative, const RankedVector& positive) : QueryContext(num_markers) {
+        reset(negative, positive);
+    }
+
+    // Reusing the existing allocations for a new query.
+    void reset(const RankedVector& negative, const RankedVector& positive) {
+        scaled_ranks(my_num_markers, negative, positive, my_value_sorted, my_zero);
+        my_has_index_sorted = false;
+        my_has_dense = false;
+    }
+
+private:
+    int my_num_markers;
+    double my_zero = 0;
+    std::vector<std::pair<int, double> > my_value_sorted;
+
+    mutable bool my_has_index_sorted = false;
+    mutable std::vector<std::pair<int, double> > my_index_sorted;
+    mutable bool my_has_dense = false;
+    mutable std::vector<double> my_dense;
+
+public:
+    int num_markers() const {
+        return my_num_markers;
+    }
+
+    double zero() const {
+        return my_zero;
+    }
+
+    const std::vector<std::pair<int, double> >& value_sorted() const {
+        return my_value_sorted;
+    }
+
+    const std::vector<std::pair<int, double> >& index_sorted() const {
+        if (!my_has_index_sorted) {
+            my_index_sorted = my_value_sorted;
+            std::sort(my_index_sorted.begin(), my_index_sorted.end());
+            my_has_index_sorted = true;
+        }
+        return my_index_sorted;
+    }
+
+    const std::vector<double>& dense() const {
+        if (!my_has_dense) {
+            my_dense.resize(my_num_markers);
+            std::fill(my_dense.begin(), my_dense.end(), my_zero);
+            for (const auto& vs : my_value_sorted) {
+                my_dense[vs.first] = vs.second;
+            }
+            my_has_dense = true;
+        }
+        return my_dense;
+    }
+
+    // Creating all forms up front, e.g., before sharing the context between threads.
+    void prepare() const {
+        index_sorted();
+        dense();
+    }
+};
+
+// Overloads of the kernels in l2_kernels.h that take the query from a QueryContext.
+inline double dense_dense(const QueryContext& query, const double* dense_ref) {
+    return dense_dense(query.num_markers(), query.dense().data(), dense_ref);
+}
+
+inline double sparse_dense_interleaved(const QueryContext& query, const double* dense_ref) {
+    const auto& sparse = query.index_sorted();
+    return sparse_dense_interleaved(query.num_markers(), sparse.size(), sparse.data(), query.zero(), dense_ref);
+}
+
+inline double dense_sparse_interleaved(const QueryContext& query, const int num_nonzero, const int* sparse_ref_index, const double* sparse_ref_value, const double zero_ref) {
+    return dense_sparse_interleaved(query.num_markers(), query.dense().data(), num_nonzero, sparse_ref_index, sparse_ref_value, zero_ref);
+}
+
+inline double dense_sparse_densified(const QueryContext& query, const int num_nonzero, const int* sparse_ref_index, const double* sparse_ref_value, const double zero_ref, double* buffer) {
+    return dense_sparse_densified(query.num_markers(), query.dense().data(), num_nonzero, sparse_ref_index, sparse_ref_value, zero_ref, buffer);
+}
+
+inline double dense_sparse_unstable(const QueryContext& query, const int num_nonzero, const int* sparse_ref_index, const double* sparse_ref_value, const double zero_ref) {
+    return dense_sparse_unstable(query.num_markers(), query.dense().data(), num_nonzero, sparse_ref_index, sparse_ref_value, zero_ref);
+}
+
+// The unstable kernel doesn't need the entries to be sorted by index, so we use the value-sorted form that is always available.
+inline double sparse_dense_unstable(const QueryContext& query, const double* dense_ref) {
+    const auto& sparse = query.value_sorted();
+    return sparse_dense_unstable(query.num_markers(), sparse.size(), sparse.data(), query.zero(), dense_ref);
+}
+
+inline double sparse_sparse_interleaved(const QueryContext& query, const int num_nonzero, const int* sparse_ref_index, const double* sparse_ref_value, const double zero_ref) {
+    const auto& sparse = query.index_sorted();
+    return sparse_sparse_interleaved(query.num_markers(), sparse.size(), sparse.data(), query.zero(), num_nonzero, sparse_ref_index, sparse_ref_value, zero_ref);
+}
+
+#endif
@@ -0,0 +1,126 @@
+#include "eztimer/eztimer.hpp"
+
+#include "CLI/App.hpp"
+#include "CLI/Formatter.hpp"
+#include "CLI/Config.hpp"
+
+#include "scaled_ranks.h"
+#include "short_ranks.h"
+
+#include <random>
+#include <vector>
+#include <optional>
+#include <iostream>
+#include <cstdint>
+
+int main(int argc, char ** argv) {
+    CLI::App app{"Ranking performance tests for short vectors"};
+    std::vector<int> lengths { 8, 16, 32, 48, 64 };
+    app.add_option("-l,--length", lengths, "Lengths of the simulated vectors, no greater than 64");
+    bool ties;
+    app.add_flag("--ties", ties, "Simulate integer counts with many ties, instead of continuous values");
+    int iterations;
+    app.add_option("-i,--iter", iterations, "Number of iterations")->default_val(100);
+    unsigned long long seed;
+    app.add_option("-s,--seed", seed, "Seed for the simulated data")->default_val(69);
+    CLI11_PARSE(app, argc, argv);
+
+    std::mt19937_64 rng(seed);
+    std::normal_distribution<> normdist;
+    std::poisson_distribution<> poisdist(2);
+
+    for (const int len : lengths) {
+        if (len > max_short_size) {
+            throw std::runtime_error("lengths should be no greater than " + std::to_string(max_short_size));
+        }
+        std::cout << "# Length: " << len << std::endl;
+
+        RankedVector unsorted;
+        unsorted.reserve(len);
+        std::optional<double> result;
+
+        eztimer::Options opt;
+        opt.iterations = iterations;
+        opt.setup = [&]() -> void {
+            unsorted.clear();
+            for (int i = 0; i < len; ++i) {
+                unsorted.emplace_back(ties ? poisdist(rng) : normdist(rng), i);
+            }
+            result.reset();
+        };
+
+        // Each function returns a checksum of the centered ranks and their sum of squares.
+        std::vector<double> buffer(len);
+        auto checksum = [&](const double sum_squares) -> double {
+            double total = sum_squares;
+            for (int i = 0; i < len; ++i) {
+                total += buffer[i] * (i + 1);
+            }
+            return total;
+        };
+
+        std::vector<std::function<double()> > funs;
+        std::vector<std::string> names;
+
+        names.push_back("std-sort");
+        RankedVector sorted;
+        sorted.reserve(len);
+        funs.emplace_back([&]() -> double {
+            sorted = unsorted;
+            std::sort(sorted.begin(), sorted.end());
+            return checksum(centered_ranks(len, sorted, buffer.data()));
+        });
+
+        // Compile-time network from fixed_size.h, which relies on the compiler's auto-vectorization.
+        names.push_back("bitonic-portable");
+        alignas(64) double values[max_short_size];
+        alignas(64) std::int64_t indices[max_short_size];
+        funs.emplace_back([&]() -> double {
+            for (int i = 0; i < len; ++i) {
+                values[i] = unsorted[i].first;
+                indices[i] = unsorted[i].second;
+            }
+            dispatch_fixed_size(len, [&](auto size) -> void {
+                std::fill(values + len, values + size.value, std::numeric_limits<double>::infinity());
+                bitonic_sort<size.value>(values, indices);
+            });
+
+            sorted.clear();
+            for (int i = 0; i < len; ++i) {
+                sorted.emplace_back(values[i], indices[i]);
+            }
+            return checksum(centered_ranks(len, sorted, buffer.data()));
+        });
+
+        names.push_back("short-centered-ranks");
+        funs.emplace_back([&]() -> double {
+            return checksum(short_centered_ranks(len, unsorted, buffer.data()));
+        });
+
+        auto res = eztimer::time<double>(
+            funs,
+            [&](const double& res, std::size_t i) -> void {
+                if (result.has_value()) {
+                    if (std::abs(*result - res) > 1e-8 * std::abs(res)) {
+                        std::cout << *result << "\t" << res << "\t" << names[i] << std::endl;
+                        throw std::runtime_error("oops that's not right");
+                    }
+                } else {
+                    result = res;
+                }
+            },
+            opt
+        );
+
+        for (std::size_t n = 0; n < names.size(); ++n) {
+            std::string nn = names[n];
+            nn.resize(32, ' ');
+            const double mu = res[n].mean.count();
+            const double se = res[n].sd.count() / std::sqrt(res[n].times.size());
+            std::cout << nn << ": " << mu << " ± " << (se / mu * 100) << " %" << std::endl;
+        }
+        std::cout << std::endl;
+    }
+
+    return 0;
+}
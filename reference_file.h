@@ -0,0 +1,274 @@
+#ifndef REFERENCE_FILE_H
+#define REFERENCE_FILE_H
+
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <stdexcept>
+#include <cstdint>
+#include <cstring>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "scaled_ranks.h"
+
+// Binary format for a block of prebuilt sparse scaled-rank references.
+// All sections start at a multiple of REFERENCE_FILE_ALIGNMENT bytes from the start of the file,
+// and each profile's non-zero entries are padded to a multiple of REFERENCE_FILE_PADDING elements,
+// so the per-profile index/value arrays of a memory-mapped file are themselves aligned.
+// Padding entries have index 0 and a value equal to the profile's zero rank, so they contribute nothing to dense-sparse-unstable.
+constexpr char REFERENCE_FILE_MAGIC[8] = { 'S', 'R', 'R', 'E', 'F', 'B', 'L', 'K' };
+constexpr std::uint32_t REFERENCE_FILE_VERSION = 1;
+constexpr std::uint32_t REFERENCE_FILE_BYTE_ORDER = 0x01020304;
+constexpr std::size_t REFERENCE_FILE_ALIGNMENT = 64;
+constexpr std::size_t REFERENCE_FILE_PADDING = REFERENCE_FILE_ALIGNMENT / sizeof(int);
+
+struct ReferenceFileHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t byte_order;
+    std::uint32_t num_markers;
+    std::uint32_t alignment;
+    std::uint64_t num_profiles;
+    std::uint64_t num_entries;
+
+    // Byte offsets of each section from the start of the file.
+    std::uint64_t zero_offset;
+    std::uint64_t start_offset;
+    std::uint64_t length_offset;
+    std::uint64_t index_offset;
+    std::uint64_t value_offset;
+    std::uint64_t file_size;
+};
+
+inline std::uint64_t align_reference_offset(const std::uint64_t offset) {
+    return (offset + REFERENCE_FILE_ALIGNMENT - 1) / REFERENCE_FILE_ALIGNMENT * REFERENCE_FILE_ALIGNMENT;
+}
+
+// In-memory version of the reference block, built from the raw values.
+struct ReferenceBlock {
+    ReferenceBlock(const int num_markers) : num_markers(num_markers) {}
+
+    int num_markers;
+    std::vector<double> zero;
+    std::vector<std::uint64_t> start;
+    std::vector<std::uint32_t> length;
+    std::vector<int> index;
+    std::vector<double> value;
+
+    std::size_t num_profiles() const {
+        return zero.size();
+    }
+
+    int num_nonzero(const std::size_t p) const {
+        return length[p];
+    }
+
+    const int* profile_index(const std::size_t p) const {
+        return index.data() + start[p];
+    }
+
+    const double* profile_value(const std::size_t p) const {
+        return value.data() + start[p];
+    }
+
+    double profile_zero(const std::size_t p) const {
+        return zero[p];
+    }
+};
+
+inline void append_reference(ReferenceBlock& block, const RankedVector& negative, const RankedVector& positive, std::vector<std::pair<int, double> >& buffer) {
+    double zero_ref;
+    scaled_ranks(block.num_markers, negative, positive, buffer, zero_ref);
+    std::sort(buffer.begin(), buffer.end());
+
+    block.zero.push_back(zero_ref);
+    block.start.push_back(block.index.size());
+    block.length.push_back(buffer.size());
+    for (const auto& b : buffer) {
+        block.index.push_back(b.first);
+        block.value.push_back(b.second);
+    }
+
+    const std::size_t leftover = buffer.size() % REFERENCE_FILE_PADDING;
+    if (leftover) {
+        const std::size_t extra = REFERENCE_FILE_PADDING - leftover;
+        block.index.insert(block.index.end(), extra, 0);
+        block.value.insert(block.value.end(), extra, zero_ref);
+    }
+}
+
+inline void save_reference_block(const std::string& path, const ReferenceBlock& block) {
+    ReferenceFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::copy(REFERENCE_FILE_MAGIC, REFERENCE_FILE_MAGIC + 8, header.magic);
+    header.version = REFERENCE_FILE_VERSION;
+    header.byte_order = REFERENCE_FILE_BYTE_ORDER;
+    header.num_markers = block.num_markers;
+    header.alignment = REFERENCE_FILE_ALIGNMENT;
+    header.num_profiles = block.num_profiles();
+    header.num_entries = block.index.size();
+
+    header.zero_offset = align_reference_offset(sizeof(ReferenceFileHeader));
+    header.start_offset = align_reference_offset(header.zero_offset + header.num_profiles * sizeof(double));
+    header.length_offset = align_reference_offset(header.start_offset + header.num_profiles * sizeof(std::uint64_t));
+    header.index_offset = align_reference_offset(header.length_offset + header.num_profiles * sizeof(std::uint32_t));
+    header.value_offset = align_reference_offset(header.index_offset + header.num_entries * sizeof(int));
+    header.file_size = header.value_offset + header.num_entries * sizeof(double);
+
+    std::ofstream output(path, std::ios::binary | std::ios::trunc);
+    if (!output) {
+        throw std::runtime_error("failed to open '" + path + "' for writing");
+    }
+
+    std::uint64_t position = 0;
+    auto write_section = [&](const std::uint64_t offset, const void* ptr, const std::size_t bytes) -> void {
+        const char padding[REFERENCE_FILE_ALIGNMENT] = {};
+        output.write(padding, offset - position);
+        output.write(static_cast<const char*>(ptr), bytes);
+        position = offset + bytes;
+    };
+
+    write_section(0, &header, sizeof(header));
+    write_section(header.zero_offset, block.zero.data(), block.zero.size() * sizeof(double));
+    write_section(header.start_offset, block.start.data(), block.start.size() * sizeof(std::uint64_t));
+    write_section(header.length_offset, block.length.data(), block.length.size() * sizeof(std::uint32_t));
+    write_section(header.index_offset, block.index.data(), block.index.size() * sizeof(int));
+    write_section(header.value_offset, block.value.data(), block.value.size() * sizeof(double));
+
+    if (!output) {
+        throw std::runtime_error("failed to write to '" + path + "'");
+    }
+}
+
+// Read-only view of a reference block in a memory-mapped file.
+// The pointers returned by the accessors refer directly to the mapping, so no copies are made.
+class MappedReferenceBlock {
+public:
+    MappedReferenceBlock(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("failed to open '" + path + "' for reading");
+        }
+
+        struct stat info;
+        if (::fstat(fd, &info) != 0) {
+            ::close(fd);
+            throw std::runtime_error("failed to stat '" + path + "'");
+        }
+        my_size = info.st_size;
+        if (my_size < sizeof(ReferenceFileHeader)) {
+            ::close(fd);
+            throw std::runtime_error("'" + path + "' is too small to be a reference file");
+        }
+
+        void* ptr = ::mmap(NULL, my_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (ptr == MAP_FAILED) {
+            throw std::runtime_error("failed to memory-map '" + path + "'");
+        }
+        my_data = static_cast<const unsigned char*>(ptr);
+
+        std::memcpy(&my_header, my_data, sizeof(ReferenceFileHeader));
+        if (std::memcmp(my_header.magic, REFERENCE_FILE_MAGIC, 8) != 0) {
+            release();
+            throw std::runtime_error("'" + path + "' is not a reference file");
+        }
+        if (my_header.version != REFERENCE_FILE_VERSION) {
+            release();
+            throw std::runtime_error("'" + path + "' has an unsupported reference file version");
+        }
+        if (my_header.byte_order != REFERENCE_FILE_BYTE_ORDER) {
+            release();
+            throw std::runtime_error("'" + path + "' was written with a different byte order");
+        }
+        if (
+            my_header.alignment != REFERENCE_FILE_ALIGNMENT ||
+            my_header.file_size > my_size ||
+            !valid_section(my_header.zero_offset, my_header.num_profiles, sizeof(double)) ||
+            !valid_section(my_header.start_offset, my_header.num_profiles, sizeof(std::uint64_t)) ||
+            !valid_section(my_header.length_offset, my_header.num_profiles, sizeof(std::uint32_t)) ||
+            !valid_section(my_header.index_offset, my_header.num_entries, sizeof(int)) ||
+            !valid_section(my_header.value_offset, my_header.num_entries, sizeof(double))
+        ) {
+            release();
+            throw std::runtime_error("'" + path + "' is truncated or corrupted");
+        }
+
+        my_zero = reinterpret_cast<const double*>(my_data + my_header.zero_offset);
+        my_start = reinterpret_cast<const std::uint64_t*>(my_data + my_header.start_offset);
+        my_length = reinterpret_cast<const std::uint32_t*>(my_data + my_header.length_offset);
+        my_index = reinterpret_cast<const int*>(my_data + my_header.index_offset);
+        my_value = reinterpret_cast<const double*>(my_data + my_header.value_offset);
+
+        // Each profile's entries must lie within the index/value sections.
+        // We don't check the indices themselves against num_markers, as that would require touching every page of the file.
+        for (std::uint64_t p = 0; p < my_header.num_profiles; ++p) {
+            if (my_start[p] > my_header.num_entries || my_length[p] > my_header.num_entries - my_start[p]) {
+                release();
+                throw std::runtime_error("'" + path + "' has an out-of-range profile");
+            }
+        }
+    }
+
+    ~MappedReferenceBlock() {
+        release();
+    }
+
+    MappedReferenceBlock(const MappedReferenceBlock&) = delete;
+    MappedReferenceBlock& operator=(const MappedReferenceBlock&) = delete;
+
+private:
+    const unsigned char* my_data = NULL;
+    std::size_t my_size = 0;
+    ReferenceFileHeader my_header;
+
+    const double* my_zero;
+    const std::uint64_t* my_start;
+    const std::uint32_t* my_length;
+    const int* my_index;
+    const double* my_value;
+
+    // Sections must be aligned (so that the casts are valid) and lie within the file, taking care to avoid overflow.
+    bool valid_section(const std::uint64_t offset, const std::uint64_t count, const std::size_t size) const {
+        return offset % REFERENCE_FILE_ALIGNMENT == 0 && offset <= my_header.file_size && count <= (my_header.file_size - offset) / size;
+    }
+
+    void release() {
+        if (my_data) {
+            ::munmap(const_cast<unsigned char*>(my_data), my_size);
+            my_data = NULL;
+        }
+    }
+
+public:
+    int num_markers() const {
+        return my_header.num_markers;
+    }
+
+    std::size_t num_profiles() const {
+        return my_header.num_profiles;
+    }
+
+    int num_nonzero(const std::size_t p) const {
+        return my_length[p];
+    }
+
+    const int* profile_index(const std::size_t p) const {
+        return my_index + my_start[p];
+    }
+
+    const double* profile_value(const std::size_t p) const {
+        return my_value + my_start[p];
+    }
+
+    double profile_zero(const std::size_t p) const {
+        return my_zero[p];
+    }
+};
+
+#endif
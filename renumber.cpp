@@ -0,0 +1,196 @@
+#include "eztimer/eztimer.hpp"
+
+#include "CLI/App.hpp"
+#include "CLI/Formatter.hpp"
+#include "CLI/Config.hpp"
+
+#include "scaled_ranks.h"
+#include "simulate.h"
+#include "renumber.h"
+#include "perf_counters.h"
+
+#include <random>
+#include <vector>
+#include <optional>
+#include <iostream>
+
+// Scaled ranks of a reference profile, sorted by index, with the zero rank subtracted from each non-zero value.
+struct SparseProfile {
+    std::vector<int> index;
+    std::vector<double> value;
+    double zero = 0;
+    bool has_nonzero = false;
+};
+
+void fill_profile(const std::vector<std::pair<int, double> >& sparse, const double zero, const bool has_nonzero, SparseProfile& output) {
+    output.index.clear();
+    output.value.clear();
+    for (const auto& s : sparse) {
+        output.index.push_back(s.first);
+        output.value.push_back(s.second - zero);
+    }
+    output.zero = zero;
+    output.has_nonzero = has_nonzero;
+}
+
+int main(int argc, char ** argv) {
+    CLI::App app{"Marker renumbering performance tests"};
+    int len;
+    app.add_option("-l,--length", len, "Number of markers")->default_val(20000);
+    int num_refs;
+    app.add_option("-r,--references", num_refs, "Number of reference profiles")->default_val(1000);
+    double median;
+    app.add_option("-m,--median-rate", median, "Median detection rate of each marker")->default_val(0.05);
+    int iterations;
+    app.add_option("-i,--iter", iterations, "Number of iterations")->default_val(100);
+    unsigned long long seed;
+    app.add_option("-s,--seed", seed, "Seed for the simulated data")->default_val(69);
+    CLI11_PARSE(app, argc, argv);
+
+    // Simulating the reference set and computing the renumbering from its non-zero frequencies.
+    std::mt19937_64 rng(seed);
+    const auto rates = simulate_detection_rates(len, median, rng);
+
+    std::vector<SparseProfile> original(num_refs), renumbered(num_refs);
+    std::vector<int> mapping;
+    {
+        std::vector<int> counts(len);
+        std::vector<RankedVector> negatives(num_refs), positives(num_refs);
+        for (int r = 0; r < num_refs; ++r) {
+            simulate_sparse(rates, rng, negatives[r], positives[r]);
+            count_nonzero(negatives[r], positives[r], counts);
+        }
+        mapping = frequency_renumbering(counts);
+
+        std::vector<std::pair<int, double> > sparse;
+        for (int r = 0; r < num_refs; ++r) {
+            double zero;
+            const bool has_nonzero = scaled_ranks(len, negatives[r], positives[r], sparse, zero);
+            std::sort(sparse.begin(), sparse.end());
+            fill_profile(sparse, zero, has_nonzero, original[r]);
+            renumber(mapping, sparse);
+            fill_profile(sparse, zero, has_nonzero, renumbered[r]);
+        }
+    }
+
+    // Reporting the number of distinct cache lines of the dense query that are touched by each reference,
+    // as a hardware-independent measure of the locality of the gathers.
+    auto lines_touched = [&](const std::vector<SparseProfile>& profiles) -> double {
+        constexpr int per_line = 64 / sizeof(double);
+        double total = 0;
+        for (const auto& p : profiles) {
+            int last = -1;
+            for (const auto i : p.index) {
+                const int line = i / per_line;
+                total += (line != last);
+                last = line;
+            }
+        }
+        return total / profiles.size();
+    };
+    std::cout << "Query cache lines per reference (original):   " << lines_touched(original) << std::endl;
+    std::cout << "Query cache lines per reference (renumbered): " << lines_touched(renumbered) << std::endl;
+    std::cout << std::endl;
+
+    // Simulating a new query at each iteration.
+    RankedVector negative_query, positive_query;
+    std::vector<std::pair<int, double> > sparse_query;
+    std::vector<double> dense_query(len), dense_query_renumbered(len);
+    std::optional<double> result;
+
+    eztimer::Options opt;
+    opt.iterations = iterations;
+    opt.setup = [&]() -> void {
+        simulate_sparse(rates, rng, negative_query, positive_query);
+        double zero_query;
+        scaled_ranks(len, negative_query, positive_query, sparse_query, zero_query);
+        std::fill(dense_query.begin(), dense_query.end(), zero_query);
+        for (const auto& sq : sparse_query) {
+            dense_query[sq.first] = sq.second;
+        }
+        renumber(mapping, dense_query.data(), dense_query_renumbered.data());
+        result.reset();
+    };
+
+    // Same as dense-sparse-unstable in basic.cpp, for all references.
+    // Each function returns a weighted sum of the L2 distances so that the check is sensitive to the order of references.
+    auto compute = [&](const std::vector<SparseProfile>& profiles, const std::vector<double>& query) -> double {
+        double output = 0;
+        for (int r = 0; r < num_refs; ++r) {
+            const auto& p = profiles[r];
+            const int num = p.index.size();
+            double l2 = 0;
+            for (int i = 0; i < num; ++i) {
+                const double target = query[p.index[i]];
+                const double ref = p.value[i];
+                l2 += ref * (ref - 2 * target);
+            }
+            const double x2 = (p.has_nonzero ? 0.25 : 0);
+            output += (x2 + l2 - len * p.zero * p.zero) * (r + 1);
+        }
+        return output;
+    };
+
+    std::vector<std::function<double()> > funs;
+    std::vector<std::string> names;
+
+    names.push_back("original");
+    funs.emplace_back([&]() -> double {
+        return compute(original, dense_query);
+    });
+
+    names.push_back("renumbered");
+    funs.emplace_back([&]() -> double {
+        return compute(renumbered, dense_query_renumbered);
+    });
+
+    auto res = eztimer::time<double>(
+        funs,
+        [&](const double& res, std::size_t i) -> void {
+            if (result.has_value()) {
+                if (std::abs(*result - res) > 1e-8 * std::abs(res)) {
+                    std::cout << *result << "\t" << res << "\t" << names[i] << std::endl;
+                    throw std::runtime_error("oops that's not right");
+                }
+            } else {
+                result = res;
+            }
+        },
+        opt
+    );
+
+    for (std::size_t n = 0; n < names.size(); ++n) {
+        std::string nn = names[n];
+        nn.resize(32, ' ');
+        const double mu = res[n].mean.count();
+        const double se = res[n].sd.count() / std::sqrt(res[n].times.size());
+        std::cout << nn << ": " << mu << " ± " << (se / mu * 100) << " %" << std::endl;
+    }
+
+    // Reporting the hardware cache misses per call, if available.
+    PerfCounters counters({ PerfEvent::CACHE_MISSES, PerfEvent::L1D_READ_MISSES });
+    std::cout << std::endl;
+    if (!counters.available()) {
+        std::cout << "Hardware counters are not available" << std::endl;
+    } else {
+        const auto& events = counters.events();
+        for (std::size_t n = 0; n < names.size(); ++n) {
+            opt.setup();
+            counters.start();
+            for (int it = 0; it < iterations; ++it) {
+                funs[n]();
+            }
+            const auto counts = counters.stop();
+
+            std::string nn = names[n];
+            nn.resize(32, ' ');
+            std::cout << nn << ":";
+            for (std::size_t e = 0; e < events.size(); ++e) {
+                std::cout << " " << perf_event_name(events[e]) << " = " << static_cast<double>(counts[e]) / iterations;
+            }
+            std::cout << std::endl;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,67 @@
+#ifndef RENUMBER_H
+#define RENUMBER_H
+
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+#include "scaled_ranks.h"
+
+// Renumbering of markers by their non-zero frequency across the reference set.
+// Markers are otherwise in arbitrary (e.g., alphabetical) order, so the gathers from the dense query in the dense-sparse kernels scatter across the entire array.
+// After renumbering, the most frequently non-zero markers occupy the lowest indices,
+// so the gathers for each reference profile are concentrated in a small number of cache lines at the start of the query.
+//
+// The same renumbering must be applied to the references and queries, but the L2 distances are unchanged.
+
+// Adds the non-zero markers of a sparse profile to the per-marker 'counts'.
+inline void count_nonzero(const RankedVector& negative, const RankedVector& positive, std::vector<int>& counts) {
+    for (const auto& x : negative) {
+        ++counts[x.second];
+    }
+    for (const auto& x : positive) {
+        ++counts[x.second];
+    }
+}
+
+// Returns the new index of each marker, where markers are ordered by decreasing counts.
+// Ties are broken by the original index so that the renumbering is deterministic.
+inline std::vector<int> frequency_renumbering(const std::vector<int>& counts) {
+    const int num_markers = counts.size();
+    std::vector<int> order(num_markers);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](const int left, const int right) -> bool {
+        return counts[left] > counts[right];
+    });
+
+    std::vector<int> mapping(num_markers);
+    for (int i = 0; i < num_markers; ++i) {
+        mapping[order[i]] = i;
+    }
+    return mapping;
+}
+
+// Renumbers the indices of a RankedVector in place. The order of the entries is unchanged, so value-sorted vectors remain sorted.
+inline void renumber(const std::vector<int>& mapping, RankedVector& ranked) {
+    for (auto& x : ranked) {
+        x.second = mapping[x.second];
+    }
+}
+
+// Renumbers a sparse vector of (index, value) pairs in place, then re-sorts it by the new indices.
+inline void renumber(const std::vector<int>& mapping, std::vector<std::pair<int, double> >& sparse) {
+    for (auto& x : sparse) {
+        x.first = mapping[x.first];
+    }
+    std::sort(sparse.begin(), sparse.end());
+}
+
+// Renumbers a dense vector, storing the result in 'output'.
+inline void renumber(const std::vector<int>& mapping, const double* dense, double* output) {
+    const int num_markers = mapping.size();
+    for (int i = 0; i < num_markers; ++i) {
+        output[mapping[i]] = dense[i];
+    }
+}
+
+#endif
@@ -0,0 +1,191 @@
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+// Bounded lock-free queues for passing work between pipeline stages.
+// The capacity is always rounded up to a power of two so that positions can be wrapped with a mask.
+inline std::size_t ring_buffer_capacity(std::size_t capacity) {
+    std::size_t output = 1;
+    while (output < capacity) {
+        output *= 2;
+    }
+    return output;
+}
+
+// Single-producer, single-consumer queue.
+// The producer only writes the tail and the consumer only writes the head, so no read-modify-write operations are needed.
+template<typename Item_>
+class SpscQueue {
+public:
+    SpscQueue(const std::size_t capacity) :
+        my_capacity(ring_buffer_capacity(capacity)),
+        my_mask(my_capacity - 1),
+        my_buffer(new Item_[my_capacity])
+    {}
+
+private:
+    std::size_t my_capacity, my_mask;
+    std::unique_ptr<Item_[]> my_buffer;
+
+    // Keeping the positions on separate cache lines to avoid false sharing between the producer and consumer.
+    alignas(64) std::atomic<std::size_t> my_head{0};
+    alignas(64) std::atomic<std::size_t> my_tail{0};
+
+public:
+    bool try_push(const Item_& item) {
+        const std::size_t tail = my_tail.load(std::memory_order_relaxed);
+        if (tail - my_head.load(std::memory_order_acquire) == my_capacity) {
+            return false;
+        }
+        my_buffer[tail & my_mask] = item;
+        my_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_pop(Item_& item) {
+        const std::size_t head = my_head.load(std::memory_order_relaxed);
+        if (head == my_tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = my_buffer[head & my_mask];
+        my_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Approximate number of items in the queue, for monitoring purposes.
+    std::size_t size() const {
+        const std::size_t head = my_head.load(std::memory_order_relaxed);
+        const std::size_t tail = my_tail.load(std::memory_order_relaxed);
+        return tail - head;
+    }
+
+    std::size_t capacity() const {
+        return my_capacity;
+    }
+};
+
+// Multi-producer, multi-consumer queue, following Dmitry Vyukov's bounded queue design.
+// Each slot has a sequence number that tells producers and consumers whether it is ready for them,
+// so that each operation only needs a single compare-and-swap on the shared position.
+// The capacity must be at least 2, as a single slot's sequence number after a push (pos + 1) is indistinguishable from its empty state for the next position;
+// smaller capacities are silently increased.
+template<typename Item_>
+class MpmcQueue {
+public:
+    MpmcQueue(const std::size_t capacity) :
+        my_capacity(ring_buffer_capacity(std::max<std::size_t>(capacity, 2))),
+        my_mask(my_capacity - 1),
+        my_slots(new Slot[my_capacity])
+    {
+        for (std::size_t i = 0; i < my_capacity; ++i) {
+            my_slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    struct Slot {
+        std::atomic<std::size_t> sequence;
+        Item_ item;
+    };
+
+    std::size_t my_capacity, my_mask;
+    std::unique_ptr<Slot[]> my_slots;
+    alignas(64) std::atomic<std::size_t> my_enqueue{0};
+    alignas(64) std::atomic<std::size_t> my_dequeue{0};
+
+public:
+    bool try_push(const Item_& item) {
+        std::size_t pos = my_enqueue.load(std::memory_order_relaxed);
+        Slot* slot;
+        while (1) {
+            slot = &(my_slots[pos & my_mask]);
+            const std::size_t sequence = slot->sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(pos);
+            if (diff == 0) {
+                if (my_enqueue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = my_enqueue.load(std::memory_order_relaxed);
+            }
+        }
+        slot->item = item;
+        slot->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_pop(Item_& item) {
+        std::size_t pos = my_dequeue.load(std::memory_order_relaxed);
+        Slot* slot;
+        while (1) {
+            slot = &(my_slots[pos & my_mask]);
+            const std::size_t sequence = slot->sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (my_dequeue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = my_dequeue.load(std::memory_order_relaxed);
+            }
+        }
+        item = slot->item;
+        slot->sequence.store(pos + my_capacity, std::memory_order_release);
+        return true;
+    }
+
+    std::size_t size() const {
+        const std::size_t head = my_dequeue.load(std::memory_order_relaxed);
+        const std::size_t tail = my_enqueue.load(std::memory_order_relaxed);
+        return (tail > head ? tail - head : 0);
+    }
+
+    std::size_t capacity() const {
+        return my_capacity;
+    }
+};
+
+// Wrapper that uses the cheaper SPSC queue when there is only one thread on each side, and the MPMC queue otherwise.
+template<typename Item_>
+class Channel {
+public:
+    Channel(const std::size_t capacity, const int num_producers, const int num_consumers) {
+        if (num_producers == 1 && num_consumers == 1) {
+            my_spsc.reset(new SpscQueue<Item_>(capacity));
+        } else {
+            my_mpmc.reset(new MpmcQueue<Item_>(capacity));
+        }
+    }
+
+private:
+    std::unique_ptr<SpscQueue<Item_> > my_spsc;
+    std::unique_ptr<MpmcQueue<Item_> > my_mpmc;
+
+public:
+    bool try_push(const Item_& item) {
+        return (my_spsc ? my_spsc->try_push(item) : my_mpmc->try_push(item));
+    }
+
+    bool try_pop(Item_& item) {
+        return (my_spsc ? my_spsc->try_pop(item) : my_mpmc->try_pop(item));
+    }
+
+    std::size_t size() const {
+        return (my_spsc ? my_spsc->size() : my_mpmc->size());
+    }
+
+    std::size_t capacity() const {
+        return (my_spsc ? my_spsc->capacity() : my_mpmc->capacity());
+    }
+};
+
+#endif
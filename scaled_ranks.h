@@ -6,10 +6,56 @@
 #include <cmath>
 #include <type_traits>
 #include <cassert>
+#include <utility>
 
 typedef std::vector<std::pair<double, int> > RankedVector;
 
-inline double centered_ranks(const int num_markers, const RankedVector& collected, double* buffer) { 
+// Structure-of-arrays alternative to RankedVector, with the values and indices in separate arrays.
+// The tie detection only needs to scan the values and the rank assignment only needs the indices,
+// whereas each std::pair<double, int> in a RankedVector is padded to 16 bytes and drags the other member through the cache.
+struct RankedArrays {
+    std::vector<double> value;
+    std::vector<int> index;
+
+    std::size_t size() const {
+        return value.size();
+    }
+
+    void clear() {
+        value.clear();
+        index.clear();
+    }
+
+    void reserve(const std::size_t n) {
+        value.reserve(n);
+        index.reserve(n);
+    }
+
+    void emplace_back(const double v, const int i) {
+        value.push_back(v);
+        index.push_back(i);
+    }
+};
+
+// Accessors for the value and index of the 'i'-th element, so that the same implementations can be used for both RankedVector and RankedArrays.
+inline double ranked_value(const RankedVector& ranked, const int i) {
+    return ranked[i].first;
+}
+
+inline int ranked_index(const RankedVector& ranked, const int i) {
+    return ranked[i].second;
+}
+
+inline double ranked_value(const RankedArrays& ranked, const int i) {
+    return ranked.value[i];
+}
+
+inline int ranked_index(const RankedArrays& ranked, const int i) {
+    return ranked.index[i];
+}
+
+template<class Ranked_>
+double centered_ranks(const int num_markers, const Ranked_& collected, double* buffer) { 
     if (num_markers == 0) {
         return 0;
     }
@@ -18,33 +64,28 @@ inline double centered_ranks(const int num_markers, const RankedVector& collecte
     double sum_squares = 0;
 
     // Computing tied ranks. 
+    const int num = collected.size();
     int cur_rank = 0;
-    auto cIt = collected.begin();
-    const auto cEnd = collected.end();
-
-    while (cIt != cEnd) {
-        auto copy = cIt;
+    while (cur_rank < num) {
+        int copy = cur_rank;
         do {
             ++copy;
-        } while (copy != cEnd && copy->first == cIt->first);
+        } while (copy < num && ranked_value(collected, copy) == ranked_value(collected, cur_rank));
 
-        const double jump = copy - cIt;
+        const double jump = copy - cur_rank;
         const double mean_rank = cur_rank + (jump - 1) / static_cast<double>(2) - center_rank;
         sum_squares += mean_rank * mean_rank * jump;
 
-        while (cIt != copy) {
-            buffer[cIt->second] = mean_rank;
-            ++cIt;
+        for (; cur_rank < copy; ++cur_rank) {
+            buffer[ranked_index(collected, cur_rank)] = mean_rank;
         }
-
-        cur_rank += jump;
     }
 
     return sum_squares;
 }
 
-template<class Process_>
-bool scaled_ranks(const int num_markers, const RankedVector& collected, double* buffer, Process_ process) { 
+template<class Ranked_, class Process_>
+bool scaled_ranks(const int num_markers, const Ranked_& collected, double* buffer, Process_ process) { 
     const double sum_squares = centered_ranks(num_markers, collected, buffer);
 
     // Special behaviour for no-variance cells; these are left as all-zero scaled ranks.
@@ -62,11 +103,11 @@ bool scaled_ranks(const int num_markers, const RankedVector& collected, double*
     }
 }
 
-template<class ZeroProcess_, class Process_>
+template<class Ranked_, class ZeroProcess_, class Process_>
 bool scaled_ranks(
     const int num_markers,
-    const RankedVector& negative,
-    const RankedVector& positive,
+    const Ranked_& negative,
+    const Ranked_& positive,
     std::vector<std::pair<int, double> >& buffer,
     ZeroProcess_ zero,
     Process_ process
@@ -79,28 +120,30 @@ bool scaled_ranks(
 
     const double center_rank = static_cast<double>(num_markers - 1) / static_cast<double>(2); 
     double sum_squares = 0;
-
-    // Computing tied ranks: before, at, and after zero.
     int cur_rank = 0;
-    auto nIt = negative.begin();
-    const auto negative_end = negative.end();
-    while (nIt != negative_end) {
-        auto copy = nIt;
-        do {
-            ++copy;
-        } while (copy != negative_end && copy->first == nIt->first);
 
-        const double jump = copy - nIt;
-        const double mean_rank = cur_rank + static_cast<double>(jump - 1) / static_cast<double>(2) - center_rank;
-        sum_squares += mean_rank * mean_rank * jump;
-
-        while (nIt != copy) {
-            buffer.emplace_back(nIt->second, mean_rank);
-            ++nIt;
+    // Computing tied ranks: before, at, and after zero.
+    auto add_ties = [&](const Ranked_& ranked) -> void {
+        const int num = ranked.size();
+        int i = 0;
+        while (i < num) {
+            int copy = i;
+            do {
+                ++copy;
+            } while (copy < num && ranked_value(ranked, copy) == ranked_value(ranked, i));
+
+            const double jump = copy - i;
+            const double mean_rank = cur_rank + static_cast<double>(jump - 1) / static_cast<double>(2) - center_rank;
+            sum_squares += mean_rank * mean_rank * jump;
+
+            for (; i < copy; ++i) {
+                buffer.emplace_back(ranked_index(ranked, i), mean_rank);
+            }
+            cur_rank += jump;
         }
+    };
 
-        cur_rank += jump;
-    }
+    add_ties(negative);
 
     int num_zero = num_markers - negative.size() - positive.size();
     double zero_rank = 0; 
@@ -110,25 +153,7 @@ bool scaled_ranks(
         cur_rank += num_zero;
     }
 
-    auto pIt = positive.begin();
-    const auto positive_end = positive.end();
-    while (pIt != positive_end) {
-        auto copy = pIt;
-        do {
-            ++copy;
-        } while (copy != positive_end && copy->first == pIt->first);
-
-        const double jump = copy - pIt;
-        const double mean_rank = cur_rank + static_cast<double>(jump - 1) / static_cast<double>(2) - center_rank;
-        sum_squares += mean_rank * mean_rank * jump;
-
-        while (pIt != copy) {
-            buffer.emplace_back(pIt->second, mean_rank);
-            ++pIt;
-        }
-
-        cur_rank += jump;
-    }
+    add_ties(positive);
 
     // Special behaviour for no-variance cells; these are left as all-zero scaled ranks.
     if (sum_squares == 0) {
@@ -145,10 +170,11 @@ bool scaled_ranks(
     return true;
 }
 
-inline bool scaled_ranks(
+template<class Ranked_>
+bool scaled_ranks(
     const int num_markers,
-    const RankedVector& negative,
-    const RankedVector& positive,
+    const Ranked_& negative,
+    const Ranked_& positive,
     std::vector<std::pair<int, double> >& buffer,
     double& zero_rank
 ) {
@@ -0,0 +1,66 @@
+#ifndef SCRATCH_BUFFER_H
+#define SCRATCH_BUFFER_H
+
+#include <vector>
+#include <cstdint>
+
+// Dense scratch buffer that can be "cleared" in constant time.
+// Each entry is stamped with the generation in which it was last set, and entries with an older stamp are treated as unset.
+// This avoids filling the entire buffer with the zero rank (or resetting the touched entries) for every reference profile,
+// at the cost of reading the stamp alongside each value.
+class GenerationBuffer {
+public:
+    // Values and stamps are interleaved so that each set() only touches one cache line.
+    struct Entry {
+        double value = 0;
+        std::uint32_t stamp = 0;
+    };
+
+public:
+    GenerationBuffer() = default;
+
+    GenerationBuffer(const int size) : my_entries(size) {}
+
+public:
+    // Starts a new generation, in which all entries are unset.
+    void next() {
+        ++my_generation;
+
+        // On wrap-around, we need to clear the stamps so that stamps from 2^32 generations ago don't look current.
+        if (my_generation == 0) {
+            for (auto& entry : my_entries) {
+                entry.stamp = 0;
+            }
+            my_generation = 1;
+        }
+    }
+
+    void set(const int i, const double value) {
+        auto& entry = my_entries[i];
+        entry.value = value;
+        entry.stamp = my_generation;
+    }
+
+    // Returns the value of entry 'i' if it was set in the current generation, otherwise 'fallback'.
+    double get(const int i, const double fallback) const {
+        const auto& entry = my_entries[i];
+        return (entry.stamp == my_generation ? entry.value : fallback);
+    }
+
+    // Raw pointer for use in tight loops, so that the compiler doesn't need to worry about aliasing with the vector internals.
+    const Entry* entries() const {
+        return my_entries.data();
+    }
+
+    std::uint32_t generation() const {
+        return my_generation;
+    }
+
+private:
+    std::vector<Entry> my_entries;
+
+    // Starting at 1 so that the zero-initialized stamps are not considered to be set.
+    std::uint32_t my_generation = 1;
+};
+
+#endif
@@ -0,0 +1,157 @@
+#ifndef SHORT_RANKS_H
+#define SHORT_RANKS_H
+
+#include <algorithm>
+#include <limits>
+#include <cstdint>
+
+#if defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+#include "scaled_ranks.h"
+#include "fixed_size.h"
+
+// Ranking of short RankedVectors (up to 64 elements) that are not yet sorted by value.
+// Instead of std::sort() followed by centered_ranks(), we sort the values and indices with a bitonic network and feed the result into the tie detection.
+// With AVX-512, the entire network runs in registers: each register holds 8 values (and another holds their indices),
+// so compare-exchanges across registers are min/max-style blends, and those within a register use a lane permutation.
+constexpr int max_short_size = 64;
+
+#if defined(__AVX512F__)
+template<int Registers_>
+void bitonic_sort_avx512(double* values, std::int64_t* indices) {
+    __m512d vals[Registers_];
+    __m512i idx[Registers_];
+    for (int r = 0; r < Registers_; ++r) {
+        vals[r] = _mm512_loadu_pd(values + 8 * r);
+        idx[r] = _mm512_loadu_si512(indices + 8 * r);
+    }
+
+    constexpr int size = 8 * Registers_;
+    const __m512i lanes = _mm512_set_epi64(7, 6, 5, 4, 3, 2, 1, 0);
+
+    for (int k = 2; k <= size; k *= 2) {
+        for (int stride = k / 2; stride > 0; stride /= 2) {
+            if (stride >= 8) {
+                // Partners are in different registers, and all lanes of a register go in the same direction.
+                const int reg_stride = stride / 8;
+                for (int r = 0; r < Registers_; ++r) {
+                    // The second condition is always false, but it keeps -Warray-bounds quiet.
+                    const int partner = r + reg_stride;
+                    if ((r & reg_stride) || partner >= Registers_) {
+                        continue;
+                    }
+                    const bool ascending = (((8 * r) & k) == 0);
+                    const __mmask8 swap = (ascending ? _mm512_cmp_pd_mask(vals[r], vals[partner], _CMP_GT_OQ) : _mm512_cmp_pd_mask(vals[r], vals[partner], _CMP_LT_OQ));
+                    const __m512d lower = _mm512_mask_blend_pd(swap, vals[r], vals[partner]);
+                    const __m512d upper = _mm512_mask_blend_pd(swap, vals[partner], vals[r]);
+                    vals[r] = lower;
+                    vals[partner] = upper;
+                    const __m512i lower_idx = _mm512_mask_blend_epi64(swap, idx[r], idx[partner]);
+                    const __m512i upper_idx = _mm512_mask_blend_epi64(swap, idx[partner], idx[r]);
+                    idx[r] = lower_idx;
+                    idx[partner] = upper_idx;
+                }
+
+            } else {
+                // Partners are in the same register. Each lane takes its partner's value if the partner belongs in this lane,
+                // i.e., if the partner is smaller and this lane should hold the minimum, or vice versa.
+                // Tied lanes keep their own values, so both lanes of a pair always agree on whether to swap.
+                const __m512i perm = _mm512_xor_si512(lanes, _mm512_set1_epi64(stride));
+                for (int r = 0; r < Registers_; ++r) {
+                    __mmask8 wants_max = 0;
+                    for (int l = 0; l < 8; ++l) {
+                        const bool upper = (l & stride) != 0;
+                        const bool descending = ((8 * r + l) & k) != 0;
+                        wants_max |= static_cast<__mmask8>(upper != descending) << l;
+                    }
+
+                    // Using the zero-masked permutes with a full mask, as GCC warns about the undefined source of the unmasked versions.
+                    const __m512d partner = _mm512_maskz_permutexvar_pd(0xff, perm, vals[r]);
+                    const __m512i partner_idx = _mm512_maskz_permutexvar_epi64(0xff, perm, idx[r]);
+                    const __mmask8 take = (wants_max & _mm512_cmp_pd_mask(partner, vals[r], _CMP_GT_OQ)) | (~wants_max & _mm512_cmp_pd_mask(partner, vals[r], _CMP_LT_OQ));
+                    vals[r] = _mm512_mask_blend_pd(take, vals[r], partner);
+                    idx[r] = _mm512_mask_blend_epi64(take, idx[r], partner_idx);
+                }
+            }
+        }
+    }
+
+    for (int r = 0; r < Registers_; ++r) {
+        _mm512_storeu_pd(values + 8 * r, vals[r]);
+        _mm512_storeu_si512(indices + 8 * r, idx[r]);
+    }
+}
+#endif
+
+// Sorts the first 'num' values (and their indices) in increasing order, where 'num' is no greater than max_short_size.
+// Both arrays should have space for max_short_size elements, as the remaining entries are used for padding.
+inline void short_sort(const int num, double* values, std::int64_t* indices) {
+    std::fill(values + num, values + max_short_size, std::numeric_limits<double>::infinity());
+    std::fill(indices + num, indices + max_short_size, -1);
+
+#if defined(__AVX512F__)
+    if (num <= 8) {
+        bitonic_sort_avx512<1>(values, indices);
+    } else if (num <= 16) {
+        bitonic_sort_avx512<2>(values, indices);
+    } else if (num <= 32) {
+        bitonic_sort_avx512<4>(values, indices);
+    } else {
+        bitonic_sort_avx512<8>(values, indices);
+    }
+#else
+    if (num <= 16) {
+        bitonic_sort<16>(values, indices);
+    } else if (num <= 32) {
+        bitonic_sort<32>(values, indices);
+    } else {
+        bitonic_sort<64>(values, indices);
+    }
+#endif
+}
+
+// Equivalent to sorting 'unsorted' and calling centered_ranks().
+// Longer RankedVectors than max_short_size are still handled correctly, but they fall back to exactly that.
+inline double short_centered_ranks(const int num_markers, const RankedVector& unsorted, double* buffer) {
+    if (num_markers == 0) {
+        return 0;
+    }
+
+    const int num = unsorted.size();
+    if (num > max_short_size) {
+        RankedVector sorted(unsorted);
+        std::sort(sorted.begin(), sorted.end());
+        return centered_ranks(num_markers, sorted, buffer);
+    }
+
+    alignas(64) double values[max_short_size];
+    alignas(64) std::int64_t indices[max_short_size];
+    for (int i = 0; i < num; ++i) {
+        values[i] = unsorted[i].first;
+        indices[i] = unsorted[i].second;
+    }
+    short_sort(num, values, indices);
+
+    const double center_rank = static_cast<double>(num_markers - 1) / static_cast<double>(2);
+    double sum_squares = 0;
+    int cur_rank = 0;
+    while (cur_rank < num) {
+        int copy = cur_rank;
+        do {
+            ++copy;
+        } while (copy < num && values[copy] == values[cur_rank]);
+
+        const double jump = copy - cur_rank;
+        const double mean_rank = cur_rank + (jump - 1) / static_cast<double>(2) - center_rank;
+        sum_squares += mean_rank * mean_rank * jump;
+        for (; cur_rank < copy; ++cur_rank) {
+            buffer[indices[cur_rank]] = mean_rank;
+        }
+    }
+
+    return sum_squares;
+}
+
+#endif
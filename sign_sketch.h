@@ -0,0 +1,92 @@
+#ifndef SIGN_SKETCH_H
+#define SIGN_SKETCH_H
+
+#include <algorithm>
+#include <cstdint>
+
+#if defined(__AVX512VPOPCNTDQ__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// 1-bit sketches of scaled rank vectors, where each bit indicates whether a marker's scaled rank is above that of the zero value.
+// For sparse profiles, this is equivalent to asking whether the marker has a positive value.
+// The Hamming distance between sketches is a cheap proxy for the L2 norm that can be used to prefilter references.
+inline std::size_t sketch_words(const int num_markers) {
+    return (static_cast<std::size_t>(num_markers) + 63) / 64;
+}
+
+inline void sketch_sparse(const int num_markers, const int num_nonzero, const int* sparse_index, const double* sparse_value, const double zero, std::uint64_t* sketch) {
+    std::fill_n(sketch, sketch_words(num_markers), 0);
+    for (int i = 0; i < num_nonzero; ++i) {
+        if (sparse_value[i] > zero) {
+            const int idx = sparse_index[i];
+            sketch[idx / 64] |= static_cast<std::uint64_t>(1) << (idx % 64);
+        }
+    }
+}
+
+inline void sketch_dense(const int num_markers, const double* dense, const double zero, std::uint64_t* sketch) {
+    const std::size_t nwords = sketch_words(num_markers);
+    for (std::size_t w = 0; w < nwords; ++w) {
+        const int start = w * 64;
+        const int end = std::min(num_markers, start + 64);
+        std::uint64_t current = 0;
+        for (int i = start; i < end; ++i) {
+            current |= static_cast<std::uint64_t>(dense[i] > zero) << (i - start);
+        }
+        sketch[w] = current;
+    }
+}
+
+#if defined(__AVX2__) && !defined(__AVX512VPOPCNTDQ__)
+// Counting the bits in each byte with a nibble lookup table, then summing the bytes within each 64-bit lane.
+inline __m256i popcount_avx2(const __m256i x) {
+    const __m256i lookup = _mm256_setr_epi8(
+        0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+        0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4
+    );
+    const __m256i low_mask = _mm256_set1_epi8(0x0f);
+    const __m256i lo = _mm256_and_si256(x, low_mask);
+    const __m256i hi = _mm256_and_si256(_mm256_srli_epi16(x, 4), low_mask);
+    const __m256i counts = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, lo), _mm256_shuffle_epi8(lookup, hi));
+    return _mm256_sad_epu8(counts, _mm256_setzero_si256());
+}
+#endif
+
+inline int hamming_distance(const std::size_t num_words, const std::uint64_t* left, const std::uint64_t* right) {
+    std::size_t w = 0;
+    int total = 0;
+
+#if defined(__AVX512VPOPCNTDQ__)
+    __m512i acc = _mm512_setzero_si512();
+    for (; w + 8 <= num_words; w += 8) {
+        const __m512i x = _mm512_xor_si512(_mm512_loadu_si512(left + w), _mm512_loadu_si512(right + w));
+        acc = _mm512_add_epi64(acc, _mm512_popcnt_epi64(x));
+    }
+    alignas(64) std::uint64_t lanes[8];
+    _mm512_store_si512(lanes, acc);
+    for (auto l : lanes) {
+        total += l;
+    }
+#elif defined(__AVX2__)
+    __m256i acc = _mm256_setzero_si256();
+    for (; w + 4 <= num_words; w += 4) {
+        const __m256i x = _mm256_xor_si256(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(left + w)),
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(right + w))
+        );
+        acc = _mm256_add_epi64(acc, popcount_avx2(x));
+    }
+    alignas(32) std::uint64_t lanes[4];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), acc);
+    total += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+
+    // Remaining words, or all of them if no SIMD is available. This compiles to popcnt if the target supports it.
+    for (; w < num_words; ++w) {
+        total += __builtin_popcountll(left[w] ^ right[w]);
+    }
+    return total;
+}
+
+#endif
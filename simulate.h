@@ -0,0 +1,119 @@
+#ifndef SIMULATE_H
+#define SIMULATE_H
+
+#include <algorithm>
+#include <random>
+#include <vector>
+#include <cmath>
+
+#include "scaled_ranks.h"
+
+// Simulates a sparse profile in the same manner as basic.cpp and fine_tune.cpp,
+// storing the negative and positive values separately and sorted by value.
+template<class Engine_>
+void simulate_sparse(const int num_markers, const double density, Engine_& rng, RankedVector& negative, RankedVector& positive) {
+    std::normal_distribution<> normdist;
+    std::uniform_real_distribution<> unifdist;
+
+    negative.clear();
+    positive.clear();
+    for (int i = 0; i < num_markers; ++i) {
+        if (unifdist(rng) <= density) {
+            double val = normdist(rng);
+            if (val < 0) {
+                negative.emplace_back(val, i);
+            } else if (val > 0) {
+                positive.emplace_back(val, i);
+            }
+        }
+    }
+
+    std::sort(negative.begin(), negative.end());
+    std::sort(positive.begin(), positive.end());
+}
+
+// Simulates a profile around a cluster center, where 'center' contains the raw values for all markers (zero for unexpressed markers).
+// Non-zero values are perturbed by normally-distributed noise, while the zeros are left as-is to preserve the sparsity pattern.
+template<class Engine_>
+void simulate_from_center(const std::vector<double>& center, const double noise, Engine_& rng, RankedVector& negative, RankedVector& positive) {
+    std::normal_distribution<> normdist;
+
+    negative.clear();
+    positive.clear();
+    const int num_markers = center.size();
+    for (int i = 0; i < num_markers; ++i) {
+        if (center[i] != 0) {
+            double val = center[i] + noise * normdist(rng);
+            if (val < 0) {
+                negative.emplace_back(val, i);
+            } else if (val > 0) {
+                positive.emplace_back(val, i);
+            }
+        }
+    }
+
+    std::sort(negative.begin(), negative.end());
+    std::sort(positive.begin(), positive.end());
+}
+
+// Simulates per-marker detection rates for a more realistic sparsity pattern than a constant density,
+// where a few markers are non-zero in most profiles and most markers are rarely non-zero.
+// Rates are log-normally distributed around 'median' and capped at 1.
+template<class Engine_>
+std::vector<double> simulate_detection_rates(const int num_markers, const double median, Engine_& rng) {
+    std::normal_distribution<> normdist;
+    std::vector<double> rates(num_markers);
+    const double log_median = std::log(median);
+    for (auto& r : rates) {
+        r = std::min(1.0, std::exp(log_median + 1.5 * normdist(rng)));
+    }
+    return rates;
+}
+
+// Same as simulate_sparse(), but with a separate density for each marker.
+template<class Engine_>
+void simulate_sparse(const std::vector<double>& rates, Engine_& rng, RankedVector& negative, RankedVector& positive) {
+    std::normal_distribution<> normdist;
+    std::uniform_real_distribution<> unifdist;
+
+    negative.clear();
+    positive.clear();
+    const int num_markers = rates.size();
+    for (int i = 0; i < num_markers; ++i) {
+        if (unifdist(rng) <= rates[i]) {
+            double val = normdist(rng);
+            if (val < 0) {
+                negative.emplace_back(val, i);
+            } else if (val > 0) {
+                positive.emplace_back(val, i);
+            }
+        }
+    }
+
+    std::sort(negative.begin(), negative.end());
+    std::sort(positive.begin(), positive.end());
+}
+
+// Same as simulate_sparse(), but skipping directly between non-zero markers.
+// This is much faster for low densities and many references, though the simulated values differ for the same seed.
+template<class Engine_>
+void simulate_skip(const int num_markers, const double density, Engine_& rng, RankedVector& negative, RankedVector& positive) {
+    std::normal_distribution<> normdist;
+    std::geometric_distribution<> skipdist(density);
+
+    negative.clear();
+    positive.clear();
+    for (int i = skipdist(rng); i < num_markers; i += 1 + skipdist(rng)) {
+        double val = normdist(rng);
+        if (val < 0) {
+            negative.emplace_back(val, i);
+        } else if (val > 0) {
+            positive.emplace_back(val, i);
+        }
+    }
+
+    std::sort(negative.begin(), negative.end());
+    std::sort(positive.begin(), positive.end());
+}
+
+#endif
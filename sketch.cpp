@@ -0,0 +1,210 @@
+#include "eztimer/eztimer.hpp"
+
+#include "CLI/App.hpp"
+#include "CLI/Formatter.hpp"
+#include "CLI/Config.hpp"
+
+#include "scaled_ranks.h"
+#include "simulate.h"
+#include "l2_kernels.h"
+#include "reference_file.h"
+#include "sign_sketch.h"
+
+#include <random>
+#include <vector>
+#include <iostream>
+#include <cstdint>
+
+int main(int argc, char ** argv) {
+    CLI::App app{"Sign sketch prefiltering performance tests"};
+    int len;
+    app.add_option("-l,--length", len, "Length of the simulated vector")->default_val(1000);
+    double density;
+    app.add_option("-d,--density", density, "Density of non-zero elements in the simulated vector")->default_val(0.2);
+    int nlabels;
+    app.add_option("-L,--labels", nlabels, "Number of labels")->default_val(10);
+    int nperlabel;
+    app.add_option("-n,--references", nperlabel, "Number of references per label")->default_val(1000);
+    double noise;
+    app.add_option("--noise", noise, "Standard deviation of the noise around each label's center")->default_val(1);
+    int k;
+    app.add_option("-k,--top", k, "Number of top references to find for each label")->default_val(10);
+    std::vector<int> candidates { 10, 20, 50, 100, 200 };
+    app.add_option("-c,--candidates", candidates, "Number of candidates per label to pass to the exact L2 calculation");
+    int iterations;
+    app.add_option("-i,--iter", iterations, "Number of iterations")->default_val(100);
+    unsigned long long seed;
+    app.add_option("-s,--seed", seed, "Seed for the simulated data")->default_val(69);
+    CLI11_PARSE(app, argc, argv);
+
+    std::mt19937_64 rng(seed);
+    k = std::min(k, nperlabel);
+
+    // Simulating references around each label's center; references for each label are stored contiguously.
+    RankedVector negative, positive;
+    std::vector<std::vector<double> > centers(nlabels);
+    for (auto& center : centers) {
+        center.resize(len);
+        simulate_sparse(len, density, rng, negative, positive);
+        for (const auto& n : negative) {
+            center[n.second] = n.first;
+        }
+        for (const auto& p : positive) {
+            center[p.second] = p.first;
+        }
+    }
+
+    std::vector<std::pair<int, double> > buffer;
+    buffer.reserve(len);
+    ReferenceBlock block(len);
+    for (int l = 0; l < nlabels; ++l) {
+        for (int r = 0; r < nperlabel; ++r) {
+            simulate_from_center(centers[l], noise, rng, negative, positive);
+            append_reference(block, negative, positive, buffer);
+        }
+    }
+
+    const std::size_t nrefs = block.num_profiles();
+    const std::size_t nwords = sketch_words(len);
+    std::vector<std::uint64_t> ref_sketches(nrefs * nwords);
+    for (std::size_t r = 0; r < nrefs; ++r) {
+        sketch_sparse(len, block.num_nonzero(r), block.profile_index(r), block.profile_value(r), block.profile_zero(r), ref_sketches.data() + r * nwords);
+    }
+
+    auto exact_l2 = [&](const std::vector<double>& dense_query, std::size_t r) -> double {
+        return dense_sparse_unstable(len, dense_query.data(), block.num_nonzero(r), block.profile_index(r), block.profile_value(r), block.profile_zero(r));
+    };
+
+    // Queries are simulated from a random label, and the true top references for each label are computed in the setup.
+    std::vector<std::pair<int, double> > sparse_query;
+    sparse_query.reserve(len);
+    double zero_query;
+    std::vector<double> dense_query(len);
+    std::uniform_int_distribution<> labeldist(0, nlabels - 1);
+
+    std::vector<std::pair<double, int> > scratch(nperlabel);
+    std::vector<std::vector<int> > truth(nlabels);
+    double truth_sum = 0;
+
+    auto top_k = [&](std::vector<std::pair<double, int> >& values, int num, std::vector<int>& found) -> double {
+        std::partial_sort(values.begin(), values.begin() + k, values.begin() + num);
+        found.clear();
+        double total = 0;
+        for (int i = 0; i < k; ++i) {
+            found.push_back(values[i].second);
+            total += values[i].first;
+        }
+        return total;
+    };
+
+    eztimer::Options opt;
+    opt.iterations = iterations;
+    opt.setup = [&]() -> void {
+        simulate_from_center(centers[labeldist(rng)], noise, rng, negative, positive);
+        scaled_ranks(len, negative, positive, sparse_query, zero_query);
+        std::fill(dense_query.begin(), dense_query.end(), zero_query);
+        for (const auto& sq : sparse_query) {
+            dense_query[sq.first] = sq.second;
+        }
+
+        truth_sum = 0;
+        for (int l = 0; l < nlabels; ++l) {
+            const std::size_t offset = static_cast<std::size_t>(l) * nperlabel;
+            for (int r = 0; r < nperlabel; ++r) {
+                scratch[r].first = exact_l2(dense_query, offset + r);
+                scratch[r].second = offset + r;
+            }
+            truth_sum += top_k(scratch, nperlabel, truth[l]);
+        }
+    };
+
+    // Setting up the functions. Each function stores the top references for each label, for computing the recall later.
+    std::vector<std::function<double()> > funs;
+    std::vector<std::string> names;
+    std::vector<std::vector<std::vector<int> > > found;
+
+    names.push_back("exhaustive");
+    found.emplace_back(nlabels);
+    funs.emplace_back([&]() -> double {
+        double total = 0;
+        auto& current = found[0];
+        for (int l = 0; l < nlabels; ++l) {
+            const std::size_t offset = static_cast<std::size_t>(l) * nperlabel;
+            for (int r = 0; r < nperlabel; ++r) {
+                scratch[r].first = exact_l2(dense_query, offset + r);
+                scratch[r].second = offset + r;
+            }
+            total += top_k(scratch, nperlabel, current[l]);
+        }
+        return total;
+    });
+
+    std::vector<std::uint64_t> query_sketch(nwords);
+    std::vector<std::pair<int, int> > distances(nperlabel);
+    for (auto c : candidates) {
+        c = std::max(k, std::min(c, nperlabel));
+        names.push_back("sketch-" + std::to_string(c));
+        found.emplace_back(nlabels);
+        const std::size_t f = funs.size();
+
+        funs.emplace_back([&,c,f]() -> double {
+            sketch_dense(len, dense_query.data(), zero_query, query_sketch.data());
+            double total = 0;
+            auto& current = found[f];
+
+            for (int l = 0; l < nlabels; ++l) {
+                const std::size_t offset = static_cast<std::size_t>(l) * nperlabel;
+                for (int r = 0; r < nperlabel; ++r) {
+                    distances[r].first = hamming_distance(nwords, query_sketch.data(), ref_sketches.data() + (offset + r) * nwords);
+                    distances[r].second = offset + r;
+                }
+                std::nth_element(distances.begin(), distances.begin() + (c - 1), distances.end());
+
+                for (int i = 0; i < c; ++i) {
+                    scratch[i].first = exact_l2(dense_query, distances[i].second);
+                    scratch[i].second = distances[i].second;
+                }
+                total += top_k(scratch, c, current[l]);
+            }
+
+            return total;
+        });
+    }
+
+    // Performing the iterations. The exhaustive search must recover the truth, while the sketches are only checked for their recall.
+    std::vector<double> recall(funs.size());
+    std::vector<int> sorted_truth, sorted_found, common;
+    auto res = eztimer::time<double>(
+        funs,
+        [&](const double& res, std::size_t i) -> void {
+            if (i == 0 && std::abs(truth_sum - res) / res > 1e-8) {
+                std::cout << truth_sum << "\t" << res << "\t" << names[i] << std::endl;
+                throw std::runtime_error("oops that's not right");
+            }
+
+            int recovered = 0;
+            for (int l = 0; l < nlabels; ++l) {
+                sorted_truth = truth[l];
+                sorted_found = found[i][l];
+                std::sort(sorted_truth.begin(), sorted_truth.end());
+                std::sort(sorted_found.begin(), sorted_found.end());
+                common.clear();
+                std::set_intersection(sorted_truth.begin(), sorted_truth.end(), sorted_found.begin(), sorted_found.end(), std::back_inserter(common));
+                recovered += common.size();
+            }
+            recall[i] += static_cast<double>(recovered) / (nlabels * k);
+        },
+        opt
+    );
+
+    const double baseline = res[0].mean.count();
+    for (std::size_t n = 0; n < names.size(); ++n) {
+        std::string nn = names[n];
+        nn.resize(32, ' ');
+        const double mu = res[n].mean.count(); 
+        const double se = res[n].sd.count() / std::sqrt(res[n].times.size());
+        std::cout << nn << ": " << mu << " ± " << (se / mu * 100) << " %, speedup = " << baseline / mu << ", recall = " << recall[n] / res[n].times.size() << std::endl;
+    }
+
+    return 0;
+}
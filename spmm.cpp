@@ -0,0 +1,149 @@
+#include "eztimer/eztimer.hpp"
+
+#include "CLI/App.hpp"
+#include "CLI/Formatter.hpp"
+#include "CLI/Config.hpp"
+
+#include "scaled_ranks.h"
+#include "simulate.h"
+#include "l2_kernels.h"
+#include "reference_file.h"
+#include "spmm.h"
+
+#include <random>
+#include <vector>
+#include <optional>
+#include <iostream>
+#include <algorithm>
+
+int main(int argc, char ** argv) {
+    CLI::App app{"Sparse-dense matrix product performance tests for all-pairs scoring"};
+    int len;
+    app.add_option("-l,--length", len, "Length of the simulated vector")->default_val(1000);
+    double density;
+    app.add_option("-d,--density", density, "Density of non-zero elements in the simulated vector")->default_val(0.2);
+    std::vector<int> num_refs { 100, 1000, 10000 };
+    app.add_option("-n,--references", num_refs, "Numbers of references to test");
+    std::vector<int> num_queries { 1, 8, 64, 256 };
+    app.add_option("-q,--queries", num_queries, "Numbers of queries to test");
+    int num_threads;
+    app.add_option("-t,--threads", num_threads, "Number of threads for the threaded SpMM")->default_val(4);
+    int iterations;
+    app.add_option("-i,--iter", iterations, "Number of iterations")->default_val(10);
+    unsigned long long seed;
+    app.add_option("-s,--seed", seed, "Seed for the simulated data")->default_val(69);
+    CLI11_PARSE(app, argc, argv);
+
+    std::mt19937_64 rng(seed);
+    RankedVector negative, positive;
+    std::vector<std::pair<int, double> > buffer;
+    buffer.reserve(len);
+
+    for (const int nrefs : num_refs) {
+        // Simulating the references.
+        ReferenceBlock block(len);
+        for (int r = 0; r < nrefs; ++r) {
+            simulate_sparse(len, density, rng, negative, positive);
+            append_reference(block, negative, positive, buffer);
+        }
+
+        for (const int nqueries : num_queries) {
+            std::cout << "# References: " << nrefs << ", queries: " << nqueries << std::endl;
+
+            // Simulating the queries in the setup. Filling the query matrix is not timed,
+            // as the dense queries would also need to be constructed for the pairwise kernel.
+            std::vector<std::vector<double> > dense_queries(nqueries, std::vector<double>(len));
+            QueryMatrix matrix(len, nqueries);
+            std::vector<double> output(static_cast<std::size_t>(nrefs) * nqueries);
+            std::optional<double> result;
+
+            eztimer::Options opt;
+            opt.iterations = iterations;
+            opt.setup = [&]() -> void {
+                for (int q = 0; q < nqueries; ++q) {
+                    auto& dense_query = dense_queries[q];
+                    double zero_query;
+                    simulate_sparse(len, density, rng, negative, positive);
+                    scaled_ranks(len, negative, positive, buffer, zero_query);
+                    std::fill(dense_query.begin(), dense_query.end(), zero_query);
+                    for (const auto& sq : buffer) {
+                        dense_query[sq.first] = sq.second;
+                    }
+                    matrix.set(q, dense_query.data());
+                }
+                result.reset();
+            };
+
+            // Each function returns a weighted sum of the L2 distances for all query-reference pairs.
+            auto checksum = [&]() -> double {
+                double total = 0;
+                for (std::size_t i = 0, end = output.size(); i < end; ++i) {
+                    total += output[i] * (i % 100 + 1);
+                }
+                return total;
+            };
+
+            std::vector<std::function<double()> > funs;
+            std::vector<std::string> names;
+
+            names.push_back("pairwise");
+            funs.emplace_back([&]() -> double {
+                for (int r = 0; r < nrefs; ++r) {
+                    for (int q = 0; q < nqueries; ++q) {
+                        output[static_cast<std::size_t>(r) * nqueries + q] = dense_sparse_unstable(
+                            len,
+                            dense_queries[q].data(),
+                            block.num_nonzero(r),
+                            block.profile_index(r),
+                            block.profile_value(r),
+                            block.profile_zero(r)
+                        );
+                    }
+                }
+                return checksum();
+            });
+
+            names.push_back("spmm");
+            funs.emplace_back([&]() -> double {
+                spmm(block, matrix, output.data());
+                return checksum();
+            });
+
+            if (num_threads > 1) {
+                names.push_back("spmm-" + std::to_string(num_threads) + "-threads");
+                funs.emplace_back([&]() -> double {
+                    spmm(block, matrix, output.data(), num_threads);
+                    return checksum();
+                });
+            }
+
+            auto res = eztimer::time<double>(
+                funs,
+                [&](const double& res, std::size_t i) -> void {
+                    if (result.has_value()) {
+                        if (std::abs(*result - res) > 1e-8 * std::abs(res)) {
+                            std::cout << *result << "\t" << res << "\t" << names[i] << std::endl;
+                            throw std::runtime_error("oops that's not right");
+                        }
+                    } else {
+                        result = res;
+                    }
+                },
+                opt
+            );
+
+            const double baseline = res[0].mean.count();
+            const double npairs = static_cast<double>(nrefs) * nqueries;
+            for (std::size_t n = 0; n < names.size(); ++n) {
+                std::string nn = names[n];
+                nn.resize(32, ' ');
+                const double mu = res[n].mean.count();
+                const double se = res[n].sd.count() / std::sqrt(res[n].times.size());
+                std::cout << nn << ": " << mu << " ± " << (se / mu * 100) << " %, " << (npairs / mu / 1e6) << " M pairs/s, speedup = " << baseline / mu << std::endl;
+            }
+            std::cout << std::endl;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,90 @@
+#ifndef SPMM_H
+#define SPMM_H
+
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <cstddef>
+
+#include "multi_query.h"
+
+// All-pairs scoring of many dense queries against many sparse references as a sparse-dense matrix product.
+// In the unstable formulation, the L2 distance between a dense query and a sparse reference is 'x2 + S - n * zero^2',
+// where 'S' is a sparse dot product of the reference's centered non-zero values with '(ref - 2 * query)';
+// so for a CSR reference block and a dense query matrix, all 'S' can be computed with a single SpMM.
+//
+// The queries are stored in a marker-major QueryMatrix from multi_query.h, with the number of columns padded to a multiple of 8.
+// Each reference is then processed against blocks of columns with multi_sparse_dot(), i.e., the same kernel as for a QueryBlock,
+// where each non-zero reference entry is broadcast and multiplied against contiguous vectors of queries.
+
+// Number of columns in each register block.
+// With AVX-512, 4 accumulators of 8 doubles leave plenty of the 32 registers for the loads;
+// with AVX2, we only have 16 registers, so we use 4 accumulators of 4 doubles.
+#if defined(__AVX512F__)
+constexpr int spmm_block_columns = 32;
+#else
+constexpr int spmm_block_columns = 16;
+#endif
+
+// Computes the L2 distances between references [first, last) and all queries.
+// The distances for reference 'r' are stored in 'output + r * queries.num_queries()'.
+// 'buffer' should have space for 'queries.stride()' doubles.
+template<class Reference_>
+void spmm_rows(const Reference_& refs, const QueryMatrix& queries, const std::size_t first, const std::size_t last, double* buffer, double* output) {
+    const int num_markers = queries.num_markers();
+    const int num_queries = queries.num_queries();
+    const int stride = queries.stride();
+
+    for (std::size_t r = first; r < last; ++r) {
+        const int num_nonzero = refs.num_nonzero(r);
+        const int* index = refs.profile_index(r);
+        const double* value = refs.profile_value(r);
+        const double zero = refs.profile_zero(r);
+
+        // The stride is a multiple of 8, so the leftovers after the full blocks can be processed in blocks of 8.
+        int column = 0;
+        for (; column + spmm_block_columns <= stride; column += spmm_block_columns) {
+            multi_sparse_dot<spmm_block_columns>(queries.values() + column, stride, num_nonzero, index, value, zero, buffer + column);
+        }
+        for (; column < stride; column += 8) {
+            multi_sparse_dot<8>(queries.values() + column, stride, num_nonzero, index, value, zero, buffer + column);
+        }
+
+        // Assembling the final L2 distances.
+        const double x2 = (num_nonzero == 0 ? 0 : 0.25);
+        const double constant = x2 - num_markers * zero * zero;
+        double* current = output + r * num_queries;
+        for (int q = 0; q < num_queries; ++q) {
+            current[q] = buffer[q] + constant;
+        }
+    }
+}
+
+// Computes the L2 distances between all references and all queries, storing them in a row-major 'output' matrix with one row per reference.
+// References are split into contiguous chunks for each thread.
+template<class Reference_>
+void spmm(const Reference_& refs, const QueryMatrix& queries, double* output, const int num_threads = 1) {
+    const std::size_t num_refs = refs.num_profiles();
+    if (num_threads <= 1) {
+        std::vector<double> buffer(queries.stride());
+        spmm_rows(refs, queries, 0, num_refs, buffer.data(), output);
+        return;
+    }
+
+    std::vector<std::thread> workers;
+    workers.reserve(num_threads);
+    const std::size_t per_thread = (num_refs + num_threads - 1) / num_threads;
+    for (int t = 0; t < num_threads; ++t) {
+        const std::size_t first = std::min(num_refs, per_thread * t);
+        const std::size_t last = std::min(num_refs, first + per_thread);
+        workers.emplace_back([&, first, last]() -> void {
+            std::vector<double> buffer(queries.stride());
+            spmm_rows(refs, queries, first, last, buffer.data(), output);
+        });
+    }
+    for (auto& w : workers) {
+        w.join();
+    }
+}
+
+#endif
@@ -0,0 +1,246 @@
+#ifndef TIE_SCAN_H
+#define TIE_SCAN_H
+
+#include <algorithm>
+#include <vector>
+#include <utility>
+#include <cmath>
+#include <cstdint>
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "scaled_ranks.h"
+
+// Vectorized tie detection for centered_ranks() and scaled_ranks().
+// Rather than walking through each run of tied values with a data-dependent do/while loop,
+// we compare each value to its successor with SIMD instructions to obtain a bitmask of run boundaries for 64 values at a time.
+// Runs are then extracted from the bitmask with count-trailing-zeros, and blocks without any ties use a branch-free fast path.
+//
+// This works on both RankedVector and RankedArrays.
+// For the former, each SIMD load starts at the value of a std::pair<double, int> and also picks up the index of that pair (and its padding),
+// which is then discarded by the permutations. We never form a double* to the array as a whole, as that would be invalid pointer arithmetic;
+// the loads use the intrinsics' may-alias semantics instead, and the scalar code only uses the accessors in scaled_ranks.h.
+template<class Ranked_>
+struct TieScanTraits;
+
+template<>
+struct TieScanTraits<RankedVector> {
+    // Each std::pair<double, int> is padded to the size of two doubles, so the values are every second double in each load.
+    static_assert(sizeof(std::pair<double, int>) == 2 * sizeof(double), "unexpected padding in RankedVector");
+    static constexpr int stride = 2;
+
+    static const double* value_address(const RankedVector& ranked, const int i) {
+        return &(ranked[i].first);
+    }
+};
+
+template<>
+struct TieScanTraits<RankedArrays> {
+    static constexpr int stride = 1;
+
+    static const double* value_address(const RankedArrays& ranked, const int i) {
+        return ranked.value.data() + i;
+    }
+};
+
+// Bit 'j' is set if the value at 'start + j' differs from its successor, or if it is the last value.
+// This considers up to 64 values from 'start' onwards.
+template<class Ranked_>
+std::uint64_t tie_boundaries(const Ranked_& ranked, const int start, const int num) {
+    const int end = std::min(num, start + 64);
+    std::uint64_t mask = 0;
+    int i = start;
+
+#if defined(__AVX512F__)
+    typedef TieScanTraits<Ranked_> Traits;
+    // Each comparison needs values [i, i + 8], so the last value is always left to the scalar loop.
+    for (; i + 8 <= end && i + 8 < num; i += 8) {
+        __m512d current, next;
+        if constexpr (Traits::stride == 1) {
+            current = _mm512_loadu_pd(Traits::value_address(ranked, i));
+            next = _mm512_loadu_pd(Traits::value_address(ranked, i + 1));
+        } else {
+            // Each load covers four pairs, so we need two loads to get eight values.
+            const __m512i evens = _mm512_set_epi64(14, 12, 10, 8, 6, 4, 2, 0);
+            current = _mm512_permutex2var_pd(_mm512_loadu_pd(Traits::value_address(ranked, i)), evens, _mm512_loadu_pd(Traits::value_address(ranked, i + 4)));
+            next = _mm512_permutex2var_pd(_mm512_loadu_pd(Traits::value_address(ranked, i + 1)), evens, _mm512_loadu_pd(Traits::value_address(ranked, i + 5)));
+        }
+        const std::uint64_t different = _mm512_cmp_pd_mask(current, next, _CMP_NEQ_UQ);
+        mask |= different << (i - start);
+    }
+#elif defined(__AVX2__)
+    typedef TieScanTraits<Ranked_> Traits;
+    for (; i + 4 <= end && i + 4 < num; i += 4) {
+        __m256d current, next;
+        if constexpr (Traits::stride == 1) {
+            current = _mm256_loadu_pd(Traits::value_address(ranked, i));
+            next = _mm256_loadu_pd(Traits::value_address(ranked, i + 1));
+        } else {
+            // Each load covers two pairs; unpacklo gives us [v0, v2, v1, v3], which is then put back in order.
+            current = _mm256_permute4x64_pd(_mm256_unpacklo_pd(_mm256_loadu_pd(Traits::value_address(ranked, i)), _mm256_loadu_pd(Traits::value_address(ranked, i + 2))), 0xd8);
+            next = _mm256_permute4x64_pd(_mm256_unpacklo_pd(_mm256_loadu_pd(Traits::value_address(ranked, i + 1)), _mm256_loadu_pd(Traits::value_address(ranked, i + 3))), 0xd8);
+        }
+        const std::uint64_t different = _mm256_movemask_pd(_mm256_cmp_pd(current, next, _CMP_NEQ_UQ));
+        mask |= different << (i - start);
+    }
+#endif
+
+    for (; i < end; ++i) {
+        const bool different = (i + 1 == num || ranked_value(ranked, i) != ranked_value(ranked, i + 1));
+        mask |= static_cast<std::uint64_t>(different) << (i - start);
+    }
+    return mask;
+}
+
+// Calls 'run(first, last)' for each run of tied values in [first, last) where last - first > 1,
+// and 'singles(first, last)' for each stretch of untied values, i.e., where each value is its own run.
+template<class Ranked_, class Run_, class Singles_>
+void scan_ties(const Ranked_& ranked, Run_ run, Singles_ singles) {
+    const int num = ranked.size();
+    int run_start = 0;
+    for (int block = 0; block < num; block += 64) {
+        const int block_size = std::min(64, num - block);
+        std::uint64_t mask = tie_boundaries(ranked, block, num);
+
+        // Fast path for the common case of no ties in the entire block.
+        const std::uint64_t full = (block_size == 64 ? ~static_cast<std::uint64_t>(0) : (static_cast<std::uint64_t>(1) << block_size) - 1);
+        if (mask == full && run_start == block) {
+            singles(block, block + block_size);
+            run_start = block + block_size;
+            continue;
+        }
+
+        while (mask) {
+            const int run_end = block + __builtin_ctzll(mask) + 1;
+            if (run_end - run_start == 1) {
+                singles(run_start, run_end);
+            } else {
+                run(run_start, run_end);
+            }
+            run_start = run_end;
+            mask &= mask - 1;
+        }
+    }
+}
+
+// Equivalent to centered_ranks().
+template<class Ranked_>
+double centered_ranks_tiemask(const int num_markers, const Ranked_& collected, double* buffer) {
+    if (num_markers == 0) {
+        return 0;
+    }
+
+    const double center_rank = static_cast<double>(num_markers - 1) / static_cast<double>(2);
+    double sum_squares = 0;
+
+    scan_ties(
+        collected,
+        [&](const int first, const int last) -> void {
+            const double jump = last - first;
+            const double mean_rank = first + (jump - 1) / static_cast<double>(2) - center_rank;
+            sum_squares += mean_rank * mean_rank * jump;
+            for (int i = first; i < last; ++i) {
+                buffer[ranked_index(collected, i)] = mean_rank;
+            }
+        },
+        [&](const int first, const int last) -> void {
+            for (int i = first; i < last; ++i) {
+                const double rank = i - center_rank;
+                sum_squares += rank * rank;
+                buffer[ranked_index(collected, i)] = rank;
+            }
+        }
+    );
+
+    return sum_squares;
+}
+
+// Equivalent to the dense scaled_ranks().
+template<class Ranked_, class Process_>
+bool scaled_ranks_tiemask(const int num_markers, const Ranked_& collected, double* buffer, Process_ process) {
+    const double sum_squares = centered_ranks_tiemask(num_markers, collected, buffer);
+
+    if (sum_squares == 0) {
+        for (int i = 0; i < num_markers; ++i) {
+            process(i, 0.0);
+        }
+        return false;
+    } else {
+        const double denom = 0.5 / std::sqrt(sum_squares);
+        for (int i = 0; i < num_markers; ++i) {
+            process(i, buffer[i] * denom);
+        }
+        return true;
+    }
+}
+
+// Equivalent to the sparse scaled_ranks().
+template<class Ranked_, class ZeroProcess_, class Process_>
+bool scaled_ranks_tiemask(
+    const int num_markers,
+    const Ranked_& negative,
+    const Ranked_& positive,
+    std::vector<std::pair<int, double> >& buffer,
+    ZeroProcess_ zero,
+    Process_ process
+) {
+    buffer.clear();
+    if (num_markers == 0) {
+        zero(0);
+        return false;
+    }
+
+    const double center_rank = static_cast<double>(num_markers - 1) / static_cast<double>(2);
+    double sum_squares = 0;
+
+    // 'offset' is the rank of the first element of 'ranked'.
+    auto add_ties = [&](const Ranked_& ranked, const int offset) -> void {
+        scan_ties(
+            ranked,
+            [&](const int first, const int last) -> void {
+                const double jump = last - first;
+                const double mean_rank = offset + first + (jump - 1) / static_cast<double>(2) - center_rank;
+                sum_squares += mean_rank * mean_rank * jump;
+                for (int i = first; i < last; ++i) {
+                    buffer.emplace_back(ranked_index(ranked, i), mean_rank);
+                }
+            },
+            [&](const int first, const int last) -> void {
+                for (int i = first; i < last; ++i) {
+                    const double rank = offset + i - center_rank;
+                    sum_squares += rank * rank;
+                    buffer.emplace_back(ranked_index(ranked, i), rank);
+                }
+            }
+        );
+    };
+
+    add_ties(negative, 0);
+
+    const int num_negative = negative.size();
+    const int num_zero = num_markers - num_negative - positive.size();
+    double zero_rank = 0;
+    if (num_zero) {
+        zero_rank = num_negative + static_cast<double>(num_zero - 1) / static_cast<double>(2) - center_rank;
+        sum_squares += zero_rank * zero_rank * num_zero;
+    }
+
+    add_ties(positive, num_negative + num_zero);
+
+    if (sum_squares == 0) {
+        zero(0);
+        buffer.clear();
+        return false;
+    }
+
+    const double denom = 0.5 / std::sqrt(sum_squares);
+    zero(zero_rank * denom);
+    for (auto& nz : buffer) {
+        process(nz, nz.second * denom);
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,142 @@
+#include "eztimer/eztimer.hpp"
+
+#include "CLI/App.hpp"
+#include "CLI/Formatter.hpp"
+#include "CLI/Config.hpp"
+
+#include "scaled_ranks.h"
+#include "simulate.h"
+#include "tiled.h"
+
+#include <random>
+#include <vector>
+#include <optional>
+#include <iostream>
+#include <algorithm>
+
+int main(int argc, char ** argv) {
+    CLI::App app{"Tiled reference layout performance tests"};
+    int len;
+    app.add_option("-l,--length", len, "Length of the simulated vector")->default_val(100000);
+    double density;
+    app.add_option("-d,--density", density, "Density of non-zero elements in the simulated vector")->default_val(0.005);
+    std::vector<int> num_refs { 100, 1000, 10000, 100000 };
+    app.add_option("-r,--references", num_refs, "Numbers of reference profiles to test");
+    int tile_size;
+    app.add_option("-t,--tile", tile_size, "Number of markers in each tile")->default_val(16384);
+    int iterations;
+    app.add_option("-i,--iter", iterations, "Number of iterations")->default_val(20);
+    unsigned long long seed;
+    app.add_option("-s,--seed", seed, "Seed for the simulated data")->default_val(69);
+    CLI11_PARSE(app, argc, argv);
+
+    // Simulating the largest reference set in a reference-major CSR-like layout; smaller sets just use the first few references.
+    // Each value has the zero rank subtracted, and the rest of the L2 distance is stored in 'constant'.
+    std::mt19937_64 rng(seed);
+    const int max_refs = *std::max_element(num_refs.begin(), num_refs.end());
+    std::vector<std::size_t> ref_offsets { 0 };
+    std::vector<int> ref_index;
+    std::vector<double> ref_value;
+    std::vector<double> constant;
+    {
+        RankedVector negative, positive;
+        std::vector<std::pair<int, double> > sparse;
+        for (int r = 0; r < max_refs; ++r) {
+            simulate_skip(len, density, rng, negative, positive);
+            double zero;
+            const bool has_nonzero = scaled_ranks(len, negative, positive, sparse, zero);
+            std::sort(sparse.begin(), sparse.end());
+            for (const auto& s : sparse) {
+                ref_index.push_back(s.first);
+                ref_value.push_back(s.second - zero);
+            }
+            ref_offsets.push_back(ref_index.size());
+            constant.push_back((has_nonzero ? 0.25 : 0) - len * zero * zero);
+        }
+    }
+
+    RankedVector negative_query, positive_query;
+    std::vector<std::pair<int, double> > sparse_query;
+    std::vector<double> dense_query(len);
+
+    for (const int nrefs : num_refs) {
+        std::cout << "# References: " << nrefs << std::endl;
+
+        std::vector<std::size_t> sub_offsets(ref_offsets.begin(), ref_offsets.begin() + nrefs + 1);
+        const auto tiled = tile_references(len, tile_size, sub_offsets, ref_index, ref_value);
+        std::vector<double> output(nrefs);
+        std::optional<double> result;
+
+        eztimer::Options opt;
+        opt.iterations = iterations;
+        opt.setup = [&]() -> void {
+            simulate_skip(len, density, rng, negative_query, positive_query);
+            double zero_query;
+            scaled_ranks(len, negative_query, positive_query, sparse_query, zero_query);
+            std::fill(dense_query.begin(), dense_query.end(), zero_query);
+            for (const auto& sq : sparse_query) {
+                dense_query[sq.first] = sq.second;
+            }
+            result.reset();
+        };
+
+        // Each function returns a weighted sum of the L2 distances so that the check is sensitive to the order of references.
+        auto checksum = [&]() -> double {
+            double total = 0;
+            for (int r = 0; r < nrefs; ++r) {
+                total += (output[r] + constant[r]) * (r + 1);
+            }
+            return total;
+        };
+
+        std::vector<std::function<double()> > funs;
+        std::vector<std::string> names;
+
+        names.push_back("reference-major");
+        funs.emplace_back([&]() -> double {
+            for (int r = 0; r < nrefs; ++r) {
+                double l2 = 0;
+                for (auto i = sub_offsets[r], end = sub_offsets[r + 1]; i < end; ++i) {
+                    const double target = dense_query[ref_index[i]];
+                    const double ref = ref_value[i];
+                    l2 += ref * (ref - 2 * target);
+                }
+                output[r] = l2;
+            }
+            return checksum();
+        });
+
+        names.push_back("tile-major");
+        funs.emplace_back([&]() -> double {
+            std::fill(output.begin(), output.end(), 0);
+            tiled_dense_sparse(tiled, dense_query.data(), output.data());
+            return checksum();
+        });
+
+        auto res = eztimer::time<double>(
+            funs,
+            [&](const double& res, std::size_t i) -> void {
+                if (result.has_value()) {
+                    if (std::abs(*result - res) > 1e-8 * std::abs(res)) {
+                        std::cout << *result << "\t" << res << "\t" << names[i] << std::endl;
+                        throw std::runtime_error("oops that's not right");
+                    }
+                } else {
+                    result = res;
+                }
+            },
+            opt
+        );
+
+        for (std::size_t n = 0; n < names.size(); ++n) {
+            std::string nn = names[n];
+            nn.resize(32, ' ');
+            const double mu = res[n].mean.count();
+            const double se = res[n].sd.count() / std::sqrt(res[n].times.size());
+            std::cout << nn << ": " << mu << " ± " << (se / mu * 100) << " %" << std::endl;
+        }
+        std::cout << std::endl;
+    }
+
+    return 0;
+}
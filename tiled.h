@@ -0,0 +1,90 @@
+#ifndef TILED_H
+#define TILED_H
+
+#include <vector>
+#include <cstddef>
+
+// Tiled layout of many sparse reference profiles, for scoring all of them against a single dense query.
+// In the usual reference-major iteration, each reference gathers from the entire dense query,
+// so the query is streamed through the cache once per reference when it is too large to stay in L1/L2.
+// Here, the markers are split into tiles of 'tile_size' and the non-zero entries of all references are stored tile-major,
+// so that we can score all references against one tile of the query (which stays in L1 or L2) before moving onto the next tile.
+struct TiledReferences {
+    int num_markers = 0;
+    int tile_size = 0;
+    int num_tiles = 0;
+    int num_refs = 0;
+
+    // Entries for tile 't' and reference 'r' are stored in [offsets[t * num_refs + r], offsets[t * num_refs + r + 1]).
+    std::vector<std::size_t> offsets;
+    std::vector<int> index;
+    std::vector<double> value;
+};
+
+// Builds the tiled layout from a reference-major CSR-like layout,
+// where the entries of reference 'r' are stored in [ref_offsets[r], ref_offsets[r + 1]) and are sorted by index.
+inline TiledReferences tile_references(
+    const int num_markers,
+    const int tile_size,
+    const std::vector<std::size_t>& ref_offsets,
+    const std::vector<int>& ref_index,
+    const std::vector<double>& ref_value)
+{
+    TiledReferences output;
+    output.num_markers = num_markers;
+    output.tile_size = tile_size;
+    output.num_tiles = (num_markers + tile_size - 1) / tile_size;
+    output.num_refs = ref_offsets.size() - 1;
+    const std::size_t num_refs = output.num_refs;
+
+    // Counting the entries in each tile/reference combination, then computing the offsets.
+    output.offsets.resize(output.num_tiles * num_refs + 1);
+    for (std::size_t r = 0; r < num_refs; ++r) {
+        for (auto i = ref_offsets[r], end = ref_offsets[r + 1]; i < end; ++i) {
+            ++output.offsets[(ref_index[i] / tile_size) * num_refs + r + 1];
+        }
+    }
+    for (std::size_t o = 1; o < output.offsets.size(); ++o) {
+        output.offsets[o] += output.offsets[o - 1];
+    }
+
+    // Filling the entries; as each reference is sorted by index, its entries remain sorted within each tile.
+    // The arrays are sized from the number of counted entries, as 'ref_offsets' may only cover a prefix of 'ref_index' and 'ref_value'.
+    output.index.resize(output.offsets.back());
+    output.value.resize(output.offsets.back());
+    std::vector<std::size_t> fill(output.offsets.begin(), output.offsets.end() - 1);
+    for (std::size_t r = 0; r < num_refs; ++r) {
+        for (auto i = ref_offsets[r], end = ref_offsets[r + 1]; i < end; ++i) {
+            auto& position = fill[(ref_index[i] / tile_size) * num_refs + r];
+            output.index[position] = ref_index[i];
+            output.value[position] = ref_value[i];
+            ++position;
+        }
+    }
+
+    return output;
+}
+
+// Adds 'sum(value * (value - 2 * query[index]))' for each reference to 'output', iterating over the tiles in the outer loop.
+// This is the variable part of the L2 distance in dense-sparse-unstable, assuming that each value has already had the zero rank subtracted.
+inline void tiled_dense_sparse(const TiledReferences& refs, const double* dense_query, double* output) {
+    const std::size_t num_refs = refs.num_refs;
+    const std::size_t* offsets = refs.offsets.data();
+    const int* index = refs.index.data();
+    const double* value = refs.value.data();
+
+    for (int t = 0; t < refs.num_tiles; ++t) {
+        const std::size_t* tile_offsets = offsets + t * num_refs;
+        for (std::size_t r = 0; r < num_refs; ++r) {
+            double l2 = 0;
+            for (auto i = tile_offsets[r], end = tile_offsets[r + 1]; i < end; ++i) {
+                const double target = dense_query[index[i]];
+                const double ref = value[i];
+                l2 += ref * (ref - 2 * target);
+            }
+            output[r] += l2;
+        }
+    }
+}
+
+#endif